@@ -3,9 +3,14 @@
 #include <pscript/memory.hpp>
 #include <pscript/variable.hpp>
 #include <pscript/script.hpp>
+#include <pscript/parser.hpp>
 
-#include <plib/erased_function.hpp>
+#include <pscript/extern_function.hpp>
 
+#include <array>
+#include <deque>
+#include <functional>
+#include <span>
 #include <string>
 #include <unordered_map>
 #include <optional>
@@ -20,11 +25,15 @@ namespace peg {
 namespace ps {
 
 class extern_library;
+class function_handle;
 
 struct execution_context {
     std::istream* in = &std::cin;
     std::ostream* out = &std::cout;
     std::ostream* err = &std::cerr;
+    // Extern functions are looked up in this library on their first call, and only looked up again when a script is executed
+    // after a library in the chain was replaced or had a function added, see extern_library::version().
+    // A library must not be destroyed while a script that uses it is executing.
     extern_library* externs = nullptr;
     std::vector<std::string> module_paths = { "pscript-modules/" };
 };
@@ -38,8 +47,11 @@ public:
     /**
      * @brief Create a context.
      * @param mem_size Initial size of memory (in bytes).
+     * @param backend Parser used for scripts created with this context.
+     * @param packrat How much the parser memoizes while parsing scripts created with this context.
      */
-    explicit context(std::size_t mem_size);
+    explicit context(std::size_t mem_size, ps::parser_backend backend = ps::parser_backend::peglib,
+                     ps::packrat_mode packrat = ps::packrat_mode::adaptive);
 
     /**
      * @brief Get access to the context's memory pool.
@@ -59,14 +71,37 @@ public:
     [[maybe_unused]] void dump_memory() const noexcept;
 
     /**
-     * @brief Get a reference to the parser object used for parsing scripts.
+     * @brief Get a reference to the parser object used for parsing scripts. This parser is shared by all contexts on the calling thread,
+     *        and must only be used on that thread. The grammar is compiled once for every thread that parses at the same time: a thread
+     *        that exits leaves its parser to the next thread, so short-lived threads do not compile the grammar again.
+     * @param packrat Whether to get the parser with or without packrat parsing.
      * @return Const reference to a peg::parser.
      */
-    [[nodiscard]] peg::parser const& parser() const noexcept;
+    [[nodiscard]] peg::parser const& parser(bool packrat = true) const noexcept;
+
+    /**
+     * @brief Get the amount of rules in the grammar.
+     */
+    [[nodiscard]] static std::size_t grammar_rules() noexcept;
+
+    /**
+     * @brief Check whether peglib should use packrat parsing for a source of the given size, according to packrat().
+     */
+    [[nodiscard]] bool use_packrat(std::size_t source_size) const noexcept;
+
+    /**
+     * @brief Get the parser backend used for scripts created with this context.
+     */
+    [[nodiscard]] ps::parser_backend backend() const noexcept;
+
+    /**
+     * @brief Get the packrat mode used for scripts created with this context.
+     */
+    [[nodiscard]] ps::packrat_mode packrat() const noexcept;
 
     struct block_scope {
         block_scope* parent = nullptr;
-        std::unordered_map<std::string, ps::variable> local_variables;
+        std::unordered_map<ps::symbol, ps::variable> local_variables;
     };
 
     /**
@@ -84,50 +119,105 @@ public:
     }
 
     [[nodiscard]] ps::variable& create_variable(std::string const& name, ps::value&& initializer, block_scope* scope = nullptr);
+    [[nodiscard]] ps::variable& create_variable(ps::symbol name, ps::value&& initializer, block_scope* scope = nullptr);
 
-    [[nodiscard]] ps::variable& get_variable(std::string const& name, ps::Ast const* node = nullptr, block_scope* scope = nullptr);
-    [[nodiscard]] ps::value& get_variable_value(std::string const& name, ps::Ast const* node = nullptr, block_scope* scope = nullptr);
+    [[nodiscard]] ps::variable& get_variable(std::string const& name, ps::ast_node const* node = nullptr, block_scope* scope = nullptr);
+    [[nodiscard]] ps::variable& get_variable(ps::symbol name, ps::ast_node const* node = nullptr, block_scope* scope = nullptr);
+    [[nodiscard]] ps::value& get_variable_value(std::string const& name, ps::ast_node const* node = nullptr, block_scope* scope = nullptr);
+    [[nodiscard]] ps::value& get_variable_value(ps::symbol name, ps::ast_node const* node = nullptr, block_scope* scope = nullptr);
 
     /**
      * @brief Executes a script in this context. Note that this function is NOT safe to use in interactive mode, and may be removed in a future version.
+     *        Functions defined by the script refer to it, so it must stay alive as long as they can be called.
      * @param script Script object to execute.
      */
     void execute(ps::script const& script, ps::execution_context exec = {});
 
     /**
-     * @brief Executes a script in this context.
+     * @brief Executes a script in this context. Functions defined by the script keep it alive, so it is released once
+     *        all of them have been redefined by later scripts.
      * @param script Script object to execute.
      */
     void execute(std::shared_ptr<ps::script> const& script, ps::execution_context exec = {});
 
+    /**
+     * @brief Find a function defined by a script executed in this context, so it can be called from C++.
+     *        The function is only looked up once, calling the handle does not search for it again.
+     * @param name Name of the function, prefixed with its module name for functions in imported modules (for example std.io.print).
+     * @return Handle to the function, or an empty handle if no such function is defined.
+     */
+    [[nodiscard]] ps::function_handle find_function(std::string const& name);
+
+    class checkpoint;
+
+    /**
+     * @brief Saves the state of this context: global variables, functions, structs and imported modules.
+     *        Values are deep copied, so later changes to the context do not affect the checkpoint. Parsed scripts are shared instead of copied.
+     *        Lists and structs that are shared by several variables or elements are copied once and stay shared, and a global
+     *        variable that refers to another one (let y = &x) still refers to it.
+     * @return Checkpoint that can be passed to restore(). It must not outlive this context.
+     */
+    [[nodiscard]] checkpoint snapshot() const;
+
+    /**
+     * @brief Restores this context to a previously saved state, without reading, parsing or executing imported modules again.
+     *        A checkpoint can be restored any number of times. Must not be called while a script is executing.
+     *        Every restore deep copies all global variables of the checkpoint again, in the same way as snapshot(), so it costs
+     *        as much as copying the data they hold. Nothing is shared copy-on-write.
+     * @param saved Checkpoint created by snapshot() on this context.
+     */
+    void restore(checkpoint const& saved);
+
+    /**
+     * @brief Clears all variables, functions, structs and imported modules, so the context can be reused as if it was newly created.
+     *        Unlike creating a new context, modules that were parsed before are not read and parsed again when they are imported.
+     *        Must not be called while a script is executing.
+     */
+    void reset();
+
 private:
+    friend class function_handle;
+
     struct function {
-        // refers to key in map
-        std::string_view name;
-        ps::Ast const* node = nullptr;
+        // same as key in map
+        ps::symbol name = ps::null_symbol;
+        // function body, null for external functions. Only valid once compiled.
+        ps::ast_node const* node = nullptr;
+        // full definition, used to detect when the same function is defined again and to compile the function
+        ps::ast_node const* definition = nullptr;
+        // script the definition was parsed from, null if the caller of execute() owns it.
+        std::shared_ptr<ps::script const> owner = nullptr;
 
         struct parameter {
-            std::string name {};
+            ps::symbol name = ps::null_symbol;
             ps::type type {};
-            std::string type_name {}; // if type is a struct, stores the structs name.
+            ps::symbol type_name = ps::null_symbol; // if type is a struct, stores the structs name.
             bool is_variadic = false; // if a parameter is variadic, it will be created as a list<any> under the hood.
         };
         // parameters this function was declared with
         std::vector<parameter> params;
 
         ps::type return_type;
-        std::string return_type_name {}; // if type is a struct, stores the structs name.
+        ps::symbol return_type_name = ps::null_symbol; // if type is a struct, stores the structs name.
+
+        // functions are compiled on their first call, see compile_function()
+        bool compiled = false;
+
+        // For external functions, the function in the extern library this function is bound to, looked up on the first call.
+        ps::extern_function const* external = nullptr;
+        // value of context::externs_generation when external was looked up, 0 if it never was.
+        std::uint64_t externs_generation = 0;
     };
 
     struct struct_description {
-        // refers to key in map
-        std::string_view name;
+        // same as key in map
+        ps::symbol name = ps::null_symbol;
 
         struct member {
-            std::string name;
+            ps::symbol name = ps::null_symbol;
             ps::value default_value;
             ps::type type {};
-            std::string type_name {}; // if type is a struct, stores the structs name.
+            ps::symbol type_name = ps::null_symbol; // if type is a struct, stores the structs name.
         };
 
         std::vector<member> members;
@@ -140,93 +230,211 @@ private:
     };
 
     ps::memory_pool mem;
-    std::unordered_map<std::string, ps::variable> global_variables;
-    std::unordered_map<std::string, function> functions;
-    std::unordered_map<std::string, struct_description> structs;
-
-    struct import_data {
-        std::string filepath;
-        ps::script script;
-    };
-    std::vector<import_data> imported_scripts {};
+    ps::parser_backend parser_type = ps::parser_backend::peglib;
+    ps::packrat_mode packrat_type = ps::packrat_mode::adaptive;
+    std::unordered_map<ps::symbol, ps::variable> global_variables;
+    std::unordered_map<ps::symbol, function> functions;
+    std::unordered_map<ps::symbol, struct_description> structs;
+
+    // imported modules by file path
+    std::unordered_map<std::string, std::shared_ptr<ps::script const>> imported_scripts {};
     ps::execution_context exec_ctx;
+    // incremented every time a library in the exec_ctx.externs chain changes, so external functions know when to look up their function again.
+    std::uint64_t externs_generation = 1;
+    // versions of the libraries in the exec_ctx.externs chain when externs_generation was last updated
+    std::vector<std::uint64_t> externs_versions {};
+    // incremented every time all functions are replaced, so function handles know when to look up their function again.
+    std::uint64_t functions_generation = 1;
+
+    // increments externs_generation if a library in the exec_ctx.externs chain changed since the last call.
+    void check_externs();
 
     std::stack<function_call> call_stack {};
+    // pushes a call on the call stack and pops it again when the call ends, also when it ends with an error.
+    struct call_frame;
+    // Argument buffers of external calls in progress, one for every nesting level. Buffers keep their capacity between calls,
+    // and adding a level for a nested call never moves the buffers below it, so arguments of a running call stay in place.
+    std::deque<std::vector<ps::value>> extern_arguments {};
+    std::size_t extern_depth = 0;
 
-    std::unique_ptr<peg::parser> ast_parser;
-    // context must keep a list of scripts to make sure function node pointers etc remain valid throughout the entire context
-    // lifetime (see for example interactive mode).
-    std::vector<std::shared_ptr<ps::script>> executed_scripts;
+    // script that is currently executing, this becomes the owner of functions it defines.
+    std::shared_ptr<ps::script const> current_script = nullptr;
+    // scripts of functions that were redefined while a function was running, released once the outermost call ends.
+    std::vector<std::shared_ptr<ps::script const>> retired_scripts {};
 
-    ps::value execute(ps::Ast const* node, block_scope* scope, std::string const& namespace_prefix = ""); // namespace prefix used for importing
+    ps::value execute(ps::ast_node const* node, block_scope* scope, std::string const& namespace_prefix = ""); // namespace prefix used for importing
 
-    static ps::Ast const* find_child_with_type(ps::Ast const* node, unsigned int type) noexcept;
+    static ps::ast_node const* find_child_with_type(ps::ast_node const* node, unsigned int type) noexcept;
 
-    [[nodiscard]] ps::variable* find_variable(std::string const& name, block_scope* scope);
-    void delete_variable(std::string const& name, block_scope* scope);
+    [[nodiscard]] ps::variable* find_variable(ps::symbol name, block_scope* scope);
+    void delete_variable(ps::symbol name, block_scope* scope);
 
     // checks both name and original_name
-    static bool node_is_type(ps::Ast const* node, unsigned int type) noexcept;
-
-    static ps::type evaluate_type(ps::Ast const* node);
-    static std::string evaluate_type_name(ps::Ast const* node);
+    static bool node_is_type(ps::ast_node const* node, unsigned int type) noexcept;
 
-    void evaluate_declaration(ps::Ast const* node, block_scope* scope);
-    void evaluate_function_definition(ps::Ast const* node, std::string const& namespace_prefix = "");
-    void evaluate_struct_definition(ps::Ast const* node, std::string const& namespace_prefix = "");
-    void evaluate_extern_variable(ps::Ast const* node, std::string const& namespace_prefix = "");
+    static ps::type evaluate_type(ps::ast_node const* node);
+    static ps::symbol evaluate_type_name(ps::ast_node const* node);
 
-    void evaluate_import(ps::Ast const* node);
+    void evaluate_declaration(ps::ast_node const* node, block_scope* scope);
+    void evaluate_function_definition(ps::ast_node const* node, std::string const& namespace_prefix = "");
+    // analyzes the definition of a function: its body, parameters and return type.
+    void compile_function(function& func);
+    void evaluate_struct_definition(ps::ast_node const* node, std::string const& namespace_prefix = "");
+    void evaluate_extern_variable(ps::ast_node const* node, std::string const& namespace_prefix = "");
 
-    std::vector<ps::value> evaluate_argument_list(ps::Ast const* call_node, block_scope* scope, bool ref = false);
+    void evaluate_import(ps::ast_node const* node);
 
-    static std::string parse_namespace(ps::Ast const* node);
+    std::vector<ps::value> evaluate_argument_list(ps::ast_node const* call_node, block_scope* scope, bool ref = false);
+    // same as evaluate_argument_list(), but appends the arguments to values instead.
+    void evaluate_argument_list(ps::ast_node const* call_node, block_scope* scope, std::vector<ps::value>& values, bool ref = false);
 
     // clears variables in scope, then creates variables for arguments.
-    void prepare_function_scope(ps::Ast const* call_node, block_scope* call_scope, function* func, block_scope* func_scope);
-
-    ps::value evaluate_function_call(ps::Ast const* node, block_scope* scope);
-    ps::value evaluate_external_call(ps::Ast const* node, block_scope* scope, std::string const& name);
-    ps::value evaluate_builtin_function(std::string_view name, ps::Ast const* node, block_scope* scope);
-    ps::value evaluate_list_member_function(std::string_view name, ps::variable& object, ps::Ast const* node, block_scope* scope);
-    ps::value evaluate_string_member_function(std::string_view name, ps::variable& object, ps::Ast const* node, block_scope* scope);
+    void prepare_function_scope(ps::ast_node const* call_node, block_scope* call_scope, function* func, block_scope* func_scope);
+    // same as above, with arguments that were already evaluated. The arguments are moved into the scope.
+    void prepare_function_scope(ps::ast_node const* call_node, function* func, std::span<ps::value> arguments, block_scope* func_scope);
+
+    ps::value evaluate_function_call(ps::ast_node const* node, block_scope* scope);
+    ps::value evaluate_external_call(ps::ast_node const* node, block_scope* scope, function& func);
+    // binds func to its function in the extern library if needed, then calls it.
+    ps::value call_external(ps::ast_node const* node, function& func, std::span<ps::value const> arguments);
+    // calls a function through a handle from C++.
+    ps::value call_function(ps::function_handle& handle, std::span<ps::value> arguments);
+    // reports an error if the signature of the C++ function does not match the extern fn declaration of func.
+    void validate_external_signature(ps::ast_node const* node, function const& func, ps::extern_function const& external) const;
+    ps::value evaluate_builtin_function(ps::symbol name, ps::ast_node const* node, block_scope* scope);
+    ps::value evaluate_list_member_function(ps::symbol name, ps::variable& object, ps::ast_node const* node, block_scope* scope);
+    ps::value evaluate_string_member_function(ps::symbol name, ps::variable& object, ps::ast_node const* node, block_scope* scope);
 
     // return reference to list value, given index-expr node.
-    ps::value& index_list(ps::Ast const* node, block_scope* scope);
-    ps::value& access_member(ps::Ast const* node, block_scope* scope);
+    ps::value& index_list(ps::ast_node const* node, block_scope* scope);
+    ps::value& access_member(ps::ast_node const* node, block_scope* scope);
 
-    ps::value evaluate_operand(ps::Ast const* node, block_scope* scope, bool ref = false);
-    ps::value evaluate_operator(ps::Ast const* lhs, ps::Ast const* op, ps::Ast const* rhs, block_scope* scope);
-    ps::value evaluate_expression(ps::Ast const* node, block_scope* scope, bool ref = false);
-    ps::value evaluate_constructor_expression(ps::Ast const* node, block_scope* scope);
-    ps::value evaluate_list(ps::Ast const* node, block_scope* scope);
+    ps::value evaluate_operand(ps::ast_node const* node, block_scope* scope, bool ref = false);
+    ps::value evaluate_operator(ps::ast_node const* lhs, ps::ast_node const* op, ps::ast_node const* rhs, block_scope* scope);
+    ps::value evaluate_expression(ps::ast_node const* node, block_scope* scope, bool ref = false);
+    ps::value evaluate_constructor_expression(ps::ast_node const* node, block_scope* scope);
+    ps::value evaluate_list(ps::ast_node const* node, block_scope* scope);
 
     // returns true if cast was successful, false otherwise
     static bool try_cast(ps::value& val, ps::type from, ps::type to);
 
-    static void report_error(ps::Ast const* node, std::string_view message) ;
+    static void report_error(ps::ast_node const* node, std::string_view message) ;
+};
+
+/**
+ * @brief Saved state of a context, see context::snapshot() and context::restore().
+ */
+class context::checkpoint {
+private:
+    friend class context;
+
+    std::unordered_map<ps::symbol, ps::variable> global_variables;
+    std::unordered_map<ps::symbol, function> functions;
+    std::unordered_map<ps::symbol, struct_description> structs;
+    std::unordered_map<std::string, std::shared_ptr<ps::script const>> imported_scripts;
 };
 
 
+/**
+ * @brief Script function that can be called from C++, obtained from context::find_function().
+ *        Calling it runs only the function itself, not the script that defined it. A handle must not outlive its context.
+ */
+class function_handle {
+public:
+    /**
+     * @brief Create an empty handle, which cannot be called.
+     */
+    function_handle() = default;
+
+    /**
+     * @brief Check whether this handle refers to a function.
+     */
+    [[nodiscard]] bool valid() const noexcept;
+
+    explicit operator bool() const noexcept;
+
+    /**
+     * @brief Call the function. Arguments are converted to values like the results of external functions, and cast to the parameter
+     *        types of the function like in a call from a script.
+     * @tparam R Type to convert the return value to. Can be ps::value, void, or any type an external function can take as a parameter, except for spans.
+     * @throws std::runtime_error if the handle is empty or the call fails.
+     * @return Return value of the function.
+     */
+    template<typename R = ps::value, typename... Args>
+    R call(Args&&... args) {
+        static_assert(!is_span<std::remove_cvref_t<R>>::value, "a span cannot refer to the result of a function");
+        if (!ctx) throw std::runtime_error("Called an empty function handle.");
+
+        std::array<ps::value, sizeof...(Args)> arguments { ps::extern_result(ctx->memory(), std::forward<Args>(args))... };
+        ps::value result = invoke(arguments);
+        if constexpr (std::is_void_v<R>) {
+            return;
+        } else if constexpr (std::same_as<R, ps::value>) {
+            return result;
+        } else {
+            return R(ps::extern_argument<R>(result));
+        }
+    }
+
+private:
+    friend class context;
+
+    function_handle(ps::context* ctx, ps::symbol name, context::function* func, std::uint64_t generation);
+
+    ps::value invoke(std::span<ps::value> arguments);
+
+    ps::context* ctx = nullptr;
+    ps::symbol name = ps::null_symbol;
+    // only valid while generation equals context::functions_generation.
+    context::function* func = nullptr;
+    std::uint64_t generation = 0;
+};
+
 /**
  * @brief Interface class for external functions
  */
 class extern_library {
 public:
+    /**
+     * @brief Add an external function, see ps::extern_function for the supported signatures.
+     *        Its return value is created in the memory of the context that calls it.
+     */
     template<typename C>
-    void add_function(ps::context& ctx, std::string const& name, C&& callable) {
-        functions.insert({name, plib::make_concrete_function<ps::value>(callable, [&ctx](auto x){
-            return ps::value::from(ctx.memory(), x);
-        })});
+    void add_function(std::string const& name, C&& callable) {
+        functions.insert_or_assign(name, ps::extern_function { std::forward<C>(callable) });
+        current_version = next_version();
+    }
+
+    template<typename C>
+    void add_function([[maybe_unused]] ps::context& ctx, std::string const& name, C&& callable) {
+        add_function(name, std::forward<C>(callable));
+    }
+
+    /**
+     * @brief Add a batch function, which a script can apply to whole lists in a single call. See ps::extern_function::batch().
+     */
+    template<typename C>
+    void add_batch_function(std::string const& name, C&& kernel) {
+        functions.insert_or_assign(name, ps::extern_function::batch(std::forward<C>(kernel)));
+        current_version = next_version();
     }
 
     void add_variable(std::string const& name, void* ptr) {
         variables.insert({name, ptr});
+        current_version = next_version();
+    }
+
+    /**
+     * @brief Get a value that identifies this library and its contents. No two libraries created in the same process share a version,
+     *        and it changes whenever a function or variable is added, so contexts know when to look up their external functions again.
+     */
+    [[nodiscard]] std::uint64_t version() const noexcept {
+        return current_version;
     }
 
-    virtual plib::erased_function<ps::value>* get_function(std::string const& name) {
+    virtual ps::extern_function const* get_function(std::string const& name) {
         auto it = functions.find(name);
-        if (it != functions.end()) return it->second;
+        if (it != functions.end()) return &it->second;
         return nullptr;
     }
 
@@ -236,18 +444,27 @@ public:
         return nullptr;
     }
 
-    virtual inline ~extern_library() {
-        for (auto& [k, v] : functions) {
-            delete v;
-        }
-        functions.clear();
+    /**
+     * @brief Call on_function for every function and on_variable for every variable in this library, not including the libraries after it
+     *        in the chain. Used to flatten a chain with extern_library_chain_builder::build(). Libraries that override get_function()
+     *        or get_variable() should override this too, otherwise their names are still found, but without the flattened table.
+     */
+    virtual void enumerate(std::function<void(std::string const&, ps::extern_function const*)> const& on_function,
+                           std::function<void(std::string const&, void*)> const& on_variable) const {
+        for (auto const& [name, function] : functions) on_function(name, &function);
+        for (auto const& [name, variable] : variables) on_variable(name, variable);
     }
 
+    virtual ~extern_library() = default;
+
     std::unique_ptr<extern_library> next = nullptr;
 
 private:
-    std::unordered_map<std::string, plib::erased_function<ps::value>*> functions {};
+    static std::uint64_t next_version() noexcept;
+
+    std::unordered_map<std::string, ps::extern_function> functions {};
     std::unordered_map<std::string, void*> variables;
+    std::uint64_t current_version = next_version();
 };
 
 struct extern_library_chain_builder {
@@ -269,6 +486,12 @@ public:
     std::unique_ptr<extern_library> get() {
         return std::move(lib);
     }
+
+    /**
+     * @brief Flatten the chain into a ps::extern_registry, which finds every name with a single lookup instead of searching each library in turn.
+     *        Libraries added earlier take precedence. Functions and variables added to the libraries afterwards are not found.
+     */
+    std::unique_ptr<extern_library> build();
 };
 
 }
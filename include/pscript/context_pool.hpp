@@ -0,0 +1,68 @@
+#pragma once
+
+#include <pscript/context.hpp>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ps {
+
+/**
+ * @brief Thread-safe pool of contexts, for running many short-lived scripts without creating a new context for each of them.
+ *        Contexts are reset when they are returned to the pool, so every context handed out is clean.
+ */
+class context_pool {
+public:
+    /**
+     * @brief Owning reference to a context taken from a pool. The context is returned to the pool when the handle is destroyed.
+     */
+    class handle {
+    public:
+        handle(handle&& rhs) noexcept = default;
+        handle& operator=(handle&& rhs) noexcept;
+        ~handle();
+
+        [[nodiscard]] ps::context& operator*() const noexcept;
+        [[nodiscard]] ps::context* operator->() const noexcept;
+
+    private:
+        friend class context_pool;
+
+        handle(context_pool& pool, std::unique_ptr<ps::context> ctx) noexcept;
+
+        context_pool* pool = nullptr;
+        std::unique_ptr<ps::context> ctx = nullptr;
+    };
+
+    /**
+     * @brief Create a context pool. No contexts are created until they are needed.
+     * @param mem_size Memory size of every context in the pool (in bytes).
+     * @param backend Parser backend of every context in the pool.
+     * @param packrat Packrat mode of every context in the pool.
+     */
+    explicit context_pool(std::size_t mem_size, ps::parser_backend backend = ps::parser_backend::peglib,
+                          ps::packrat_mode packrat = ps::packrat_mode::adaptive);
+
+    /**
+     * @brief Take a context from the pool, creating a new one if all contexts are in use.
+     *        The pool must outlive the returned handle.
+     */
+    [[nodiscard]] handle acquire();
+
+    /**
+     * @brief Get the amount of contexts that are currently not in use.
+     */
+    [[nodiscard]] std::size_t available() const;
+
+private:
+    void release(std::unique_ptr<ps::context> ctx);
+
+    std::size_t mem_size = 0;
+    ps::parser_backend backend = ps::parser_backend::peglib;
+    ps::packrat_mode packrat = ps::packrat_mode::adaptive;
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<ps::context>> contexts {};
+};
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <pscript/context.hpp>
+
+#include <exception>
+#include <functional>
+#include <memory>
+
+namespace ps {
+
+/**
+ * @brief Execution of a script that can be suspended while it waits for an asynchronous external function (one that returns a std::future).
+ *        The script runs on a stack of its own, but on the thread that calls resume() and only inside resume(). External functions
+ *        therefore run on the host thread, so functions that must be called from one thread (such as OpenGL or ImGui) and thread_local
+ *        state keep working. While the script is suspended, the host can do other work, such as running other contexts or rendering frames.
+ *        The context must not be used in any other way until the execution is finished.
+ *
+ *        ps::execution run { ctx, script, exec };
+ *        while (!run.resume()) {
+ *            // do other work until the result the script waits for is ready
+ *        }
+ */
+class execution {
+public:
+    /**
+     * @brief Prepare an execution of a script. Nothing runs until resume() is called.
+     * @param ctx Context to execute the script in.
+     * @param script Script to execute, must stay alive until the execution is finished or destroyed.
+     * @param exec Options for the execution, see ps::context::execute().
+     */
+    execution(ps::context& ctx, ps::script const& script, ps::execution_context exec = {});
+
+    // the stack of the script refers to this object
+    execution(execution const&) = delete;
+    execution(execution&&) = delete;
+    execution& operator=(execution const&) = delete;
+    execution& operator=(execution&&) = delete;
+
+    /**
+     * @brief Stops an unfinished execution. The asynchronous call the script waits for is abandoned, its future is destroyed.
+     */
+    ~execution();
+
+    /**
+     * @brief Run the script until it finishes, or until it calls an asynchronous external function whose result is not ready yet.
+     *        Returns immediately if the result the script is waiting for is still not ready.
+     *        Errors in the script are reported like in ps::context::execute().
+     * @return True if the script has finished.
+     */
+    bool resume();
+
+    /**
+     * @brief Check whether the script has finished.
+     */
+    [[nodiscard]] bool finished() const noexcept;
+
+private:
+    friend void suspend_until(std::function<bool()> const& ready);
+
+    // stack and saved state of the script, depends on the platform.
+    struct fiber;
+
+    void run();
+    // creates the stack of the script, run() is called on it the first time the host switches to the script.
+    void start();
+    // continue the script until it suspends or finishes.
+    void switch_to_script();
+    // called by the script to give control back to the host, returns when the host switches to the script again.
+    void switch_to_host();
+
+    ps::context& ctx;
+    ps::script const& script;
+    ps::execution_context exec;
+
+    // created on the first resume()
+    std::unique_ptr<fiber> script_fiber;
+    bool started = false;
+    bool done = false;
+    bool cancelled = false;
+    // while suspended, returns true once the script can continue
+    std::function<bool()> waiting_for {};
+    std::exception_ptr error = nullptr;
+};
+
+}
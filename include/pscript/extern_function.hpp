@@ -0,0 +1,611 @@
+#pragma once
+
+#include <pscript/native_struct.hpp>
+#include <pscript/value.hpp>
+
+#include <array>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ps {
+
+/**
+ * @brief Parameter and return types of a callable with a single, non-template call operator.
+ */
+template<typename F>
+struct callable_traits : callable_traits<decltype(&F::operator())> {};
+
+template<typename R, typename... Args>
+struct callable_traits<R(Args...)> {
+    using result_type = R;
+    using argument_types = std::tuple<Args...>;
+    static constexpr std::size_t arity = sizeof...(Args);
+};
+
+template<typename R, typename... Args>
+struct callable_traits<R(Args...) noexcept> : callable_traits<R(Args...)> {};
+
+template<typename R, typename... Args>
+struct callable_traits<R(*)(Args...)> : callable_traits<R(Args...)> {};
+
+template<typename R, typename... Args>
+struct callable_traits<R(*)(Args...) noexcept> : callable_traits<R(Args...)> {};
+
+template<typename C, typename R, typename... Args>
+struct callable_traits<R(C::*)(Args...)> : callable_traits<R(Args...)> {};
+
+template<typename C, typename R, typename... Args>
+struct callable_traits<R(C::*)(Args...) const> : callable_traits<R(Args...)> {};
+
+template<typename C, typename R, typename... Args>
+struct callable_traits<R(C::*)(Args...) noexcept> : callable_traits<R(Args...)> {};
+
+template<typename C, typename R, typename... Args>
+struct callable_traits<R(C::*)(Args...) const noexcept> : callable_traits<R(Args...)> {};
+
+/**
+ * @brief Types a value stores its data in (ps::integer, ps::str, ps::list, ...).
+ */
+template<typename T>
+concept storage_type = requires { typename T::value_type; } && std::derived_from<T, ps::value_storage<typename T::value_type>>;
+
+/**
+ * @brief Storage type of the pscript types that are used directly in C++ (ps::string_type is stored in a ps::str, and so on).
+ */
+template<typename T>
+struct storage_of {};
+
+template<> struct storage_of<ps::string_type> { using type = ps::str; };
+template<> struct storage_of<ps::list_type> { using type = ps::list; };
+template<> struct storage_of<ps::struct_type> { using type = ps::structure; };
+template<> struct storage_of<ps::external_type> { using type = ps::external; };
+
+template<typename T>
+struct is_future : std::false_type {};
+
+template<typename T>
+struct is_future<std::future<T>> : std::true_type {};
+
+template<typename T>
+struct is_span : std::false_type {};
+
+template<typename T, std::size_t N>
+struct is_span<std::span<T, N>> : std::true_type {};
+
+/**
+ * @brief Script type that matches a C++ parameter or return type of an external function. ps::value matches any type.
+ */
+template<typename T>
+constexpr ps::type extern_type() {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (is_future<U>::value) return extern_type<decltype(std::declval<U&>().get())>();
+    else if constexpr (std::is_void_v<U>) return ps::type::null;
+    else if constexpr (std::same_as<U, bool> || std::same_as<U, ps::boolean>) return ps::type::boolean;
+    else if constexpr (std::is_floating_point_v<U> || std::same_as<U, ps::real>) return ps::type::real;
+    else if constexpr ((std::is_integral_v<U> && std::is_unsigned_v<U>) || std::same_as<U, ps::uint>) return ps::type::uint;
+    else if constexpr (std::is_integral_v<U> || std::same_as<U, ps::integer>) return ps::type::integer;
+    else if constexpr (std::same_as<U, ps::str> || std::same_as<U, ps::string_type>) return ps::type::str;
+    else if constexpr (std::same_as<U, ps::list> || std::same_as<U, ps::list_type> || is_span<U>::value) return ps::type::list;
+    else if constexpr (std::same_as<U, ps::structure> || std::same_as<U, ps::struct_type> || native_struct<U>) return ps::type::structure;
+    else if constexpr (std::same_as<U, ps::external> || std::same_as<U, ps::external_type>) return ps::type::external;
+    else return ps::type::any;
+}
+
+/**
+ * @brief Script type of a single element of a batch function parameter: the element type for spans, the parameter type otherwise.
+ */
+template<typename T>
+constexpr ps::type batch_type() {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (is_span<U>::value) return extern_type<typename U::element_type>();
+    else return extern_type<U>();
+}
+
+/**
+ * @brief Converts a numeric value to an arithmetic type, like a cast in a script.
+ * @throws std::runtime_error if the value is not numeric.
+ */
+template<typename T>
+T to_arithmetic(ps::value const& v) {
+    // most arguments already have the right type
+    if constexpr (std::same_as<T, int>) {
+        if (v.get_type() == ps::type::integer) return static_cast<ps::integer const&>(v).value();
+    } else if constexpr (std::same_as<T, unsigned int>) {
+        if (v.get_type() == ps::type::uint) return static_cast<ps::uint const&>(v).value();
+    } else if constexpr (std::same_as<T, float>) {
+        if (v.get_type() == ps::type::real) return static_cast<ps::real const&>(v).value();
+    } else if constexpr (std::same_as<T, bool>) {
+        if (v.get_type() == ps::type::boolean) return static_cast<ps::boolean const&>(v).value();
+    }
+
+    T result {};
+    visit_value(v, [&result](auto const& stored) {
+        if constexpr (std::is_arithmetic_v<std::remove_cvref_t<decltype(stored.value())>>) {
+            result = static_cast<T>(stored.value());
+        } else {
+            throw std::runtime_error("TypeError: Invalid cast in call to external function.");
+        }
+    });
+    return result;
+}
+
+/**
+ * @brief Layout and field symbols of a native struct, generated from its native_layout.
+ */
+template<native_struct T>
+class native_struct_info {
+public:
+    static constexpr std::size_t field_count = std::tuple_size_v<std::remove_cvref_t<decltype(native_layout<T>::fields)>>;
+
+    template<std::size_t I>
+    using field_type = std::remove_cvref_t<decltype(std::declval<T&>().*(std::get<I>(native_layout<T>::fields).member))>;
+
+    static constexpr std::array<struct_layout::field_info, field_count> fields = []<std::size_t... I>(std::index_sequence<I...>) {
+        return std::array<struct_layout::field_info, field_count> {
+            struct_layout::field_info { std::get<I>(native_layout<T>::fields).name, extern_type<field_type<I>>() }...
+        };
+    }(std::make_index_sequence<field_count> {});
+
+    static constexpr struct_layout layout { native_layout<T>::name, fields };
+
+    // Symbols are interned on first use, so converting a struct never looks up a name.
+    static ps::symbol type_symbol() {
+        static ps::symbol const symbol = ps::intern(native_layout<T>::name);
+        return symbol;
+    }
+
+    static std::array<ps::symbol, field_count> const& field_symbols() {
+        static std::array<ps::symbol, field_count> const symbols = [] {
+            std::array<ps::symbol, field_count> result {};
+            for (std::size_t i = 0; i < field_count; ++i) result[i] = ps::intern(fields[i].name);
+            return result;
+        }();
+        return symbols;
+    }
+};
+
+/**
+ * @brief Converts a struct value to the native struct bound to its type.
+ * @throws std::runtime_error if the value is not a struct of the type T is bound to.
+ */
+template<native_struct T>
+T to_native(ps::value const& v) {
+    using info = native_struct_info<T>;
+    if (v.get_type() != ps::type::structure || static_cast<ps::structure const&>(v)->type_symbol() != info::type_symbol()) {
+        throw std::runtime_error("TypeError: Expected a struct of type " + std::string(native_layout<T>::name) + " in call to external function.");
+    }
+
+    ps::struct_type const& fields = static_cast<ps::structure const&>(v).value();
+    T result {};
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+        ((result.*(std::get<I>(native_layout<T>::fields).member) =
+              to_arithmetic<typename info::template field_type<I>>(fields.access(info::field_symbols()[I]))), ...);
+    }(std::make_index_sequence<info::field_count> {});
+    return result;
+}
+
+/**
+ * @brief Writes the fields of a native struct back to the struct value it was converted from.
+ */
+template<native_struct T>
+void from_native(T const& native, ps::struct_type& fields) {
+    using info = native_struct_info<T>;
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+        (visit_value(fields.access(info::field_symbols()[I]), [&native](auto& stored) {
+            using stored_value = std::remove_cvref_t<decltype(stored.value())>;
+            if constexpr (std::is_arithmetic_v<stored_value>) {
+                stored.value() = static_cast<stored_value>(native.*(std::get<I>(native_layout<T>::fields).member));
+            }
+        }), ...);
+    }(std::make_index_sequence<info::field_count> {});
+}
+
+/**
+ * @brief Converts a value to an element of a span parameter: a number or a native struct.
+ */
+template<typename T>
+T to_element(ps::value const& v) {
+    if constexpr (native_struct<T>) return to_native<T>(v);
+    else return to_arithmetic<T>(v);
+}
+
+/**
+ * @brief Layout of the native struct a parameter of type T takes, directly or as the elements of a span. Null for other parameters.
+ */
+template<typename T>
+constexpr ps::struct_layout const* layout_of() {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (is_span<U>::value) return layout_of<typename U::element_type>();
+    else if constexpr (native_struct<U>) return &native_struct_info<U>::layout;
+    else return nullptr;
+}
+
+/**
+ * @brief Contiguous typed copy of the elements of a list, passed to external functions that take a std::span<T> parameter.
+ *        Lists store every element as a separate value, so the elements are gathered into a buffer first. Buffers are reused
+ *        between calls, so this only allocates when a larger list than before is passed. If T is not const, changes made through
+ *        the span are written back to the list after the call.
+ */
+template<typename T>
+class list_view {
+public:
+    using element_type = std::remove_const_t<T>;
+    static_assert((std::is_arithmetic_v<element_type> && !std::same_as<element_type, bool>) || native_struct<element_type>,
+                  "lists can only be passed as a span of a numeric type other than bool, or of a native struct");
+
+    explicit list_view(ps::list_type& list) : list(&list), buffer(acquire()) {
+        std::vector<ps::value> const& elements = list.representation();
+        buffer.resize(elements.size());
+        for (std::size_t i = 0; i < elements.size(); ++i) {
+            ps::value const& element = elements[i];
+            if constexpr (native_struct<element_type>) {
+                buffer[i] = to_native<element_type>(element);
+            } else {
+                // A list usually stores elements of a single type, only elements of another type need to be converted.
+                if (element.get_type() == stored_type) buffer[i] = static_cast<element_type>(static_cast<storage const&>(element).value());
+                else buffer[i] = to_arithmetic<element_type>(element);
+            }
+        }
+    }
+
+    /**
+     * @brief Create a view of count copies of a single value, used to pass a value to every element of a batch function.
+     */
+    list_view(element_type value, std::size_t count) : buffer(acquire()) {
+        buffer.assign(count, value);
+    }
+
+    list_view(list_view const&) = delete;
+    list_view& operator=(list_view const&) = delete;
+
+    ~list_view() {
+        if constexpr (!std::is_const_v<T>) {
+            for (std::size_t i = 0; list && i < buffer.size(); ++i) {
+                if constexpr (native_struct<element_type>) {
+                    from_native(buffer[i], static_cast<ps::structure&>(list->get(i)).value());
+                } else {
+                    visit_value(list->get(i), [value = buffer[i]](auto& stored) {
+                        using stored_value = std::remove_cvref_t<decltype(stored.value())>;
+                        if constexpr (std::is_arithmetic_v<stored_value>) stored.value() = static_cast<stored_value>(value);
+                    });
+                }
+            }
+        }
+        buffers().push_back(std::move(buffer));
+    }
+
+    operator std::span<T>() noexcept {
+        return { buffer.data(), buffer.size() };
+    }
+
+private:
+    // storage type used by lists of element_type, its elements are copied without conversion
+    using storage = std::conditional_t<std::is_floating_point_v<element_type>, ps::real,
+                        std::conditional_t<std::is_unsigned_v<element_type>, ps::uint, ps::integer>>;
+    static constexpr ps::type stored_type = std::is_floating_point_v<element_type> ? ps::type::real
+                                          : std::is_unsigned_v<element_type> ? ps::type::uint : ps::type::integer;
+
+    static std::vector<std::vector<element_type>>& buffers() {
+        static thread_local std::vector<std::vector<element_type>> free_buffers {};
+        return free_buffers;
+    }
+
+    static std::vector<element_type> acquire() {
+        auto& free_buffers = buffers();
+        if (free_buffers.empty()) return {};
+        std::vector<element_type> result = std::move(free_buffers.back());
+        free_buffers.pop_back();
+        return result;
+    }
+
+    // null if this view does not refer to a list
+    ps::list_type* list = nullptr;
+    std::vector<element_type> buffer;
+};
+
+/**
+ * @brief Converts an argument of an external call to a non-const reference parameter of type T&, which the external function can write to.
+ *        Numbers must be passed as a reference to a variable of the same type (&x), so writing to the parameter changes the variable.
+ *        Lists and structs are shared with the caller, so they can also be passed without &.
+ */
+template<typename T>
+T& extern_reference(ps::value const& arg) {
+    static_assert(std::same_as<T, int> || std::same_as<T, unsigned int> || std::same_as<T, float> || std::same_as<T, bool>
+                  || std::same_as<T, ps::list_type> || std::same_as<T, ps::struct_type>,
+                  "non-const reference parameters of external functions must be int&, unsigned int&, float&, bool&, ps::list_type& or ps::struct_type&");
+    using storage = std::conditional_t<std::same_as<T, ps::list_type>, ps::list,
+                        std::conditional_t<std::same_as<T, ps::struct_type>, ps::structure,
+                            std::conditional_t<std::same_as<T, bool>, ps::boolean, ps::arithmetic_type<T>>>>;
+
+    constexpr bool shared = std::same_as<T, ps::list_type> || std::same_as<T, ps::struct_type>;
+    if (arg.get_type() != extern_type<T>() || (!shared && !arg.is_reference())) {
+        throw std::runtime_error("TypeError: Expected a reference to a variable of type " + std::string { type_str(extern_type<T>()) }
+                                 + " in call to external function.");
+    }
+    // the argument refers to the memory of the variable, so it is only const for the argument list.
+    return static_cast<storage&>(const_cast<ps::value&>(arg)).value();
+}
+
+/**
+ * @brief Converts an argument of an external call to a parameter of type T. Arithmetic parameters are converted like a cast in a script,
+ *        lists can be passed as a std::span of a numeric type or native struct (see list_view) or as a std::span<ps::value const>.
+ *        Structs bound to a native struct (see native_layout) can be passed as that struct. Non-const references are bound to the
+ *        variable the argument refers to, see extern_reference().
+ *        All other parameters refer to the argument, so they are never copied.
+ */
+template<typename T>
+decltype(auto) extern_argument(ps::value const& arg) {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::is_lvalue_reference_v<T> && !std::is_const_v<std::remove_reference_t<T>>) {
+        return extern_reference<U>(arg);
+    } else if constexpr (std::same_as<U, ps::value>) {
+        return (arg);
+    } else if constexpr (std::is_arithmetic_v<U>) {
+        return to_arithmetic<U>(arg);
+    } else if constexpr (native_struct<U>) {
+        return to_native<U>(arg);
+    } else if constexpr (is_span<U>::value) {
+        using element = typename U::element_type;
+        if (arg.get_type() != ps::type::list) throw std::runtime_error("TypeError: Expected a list in call to external function.");
+        // lists are reference types, so the list itself is never const.
+        auto& list = const_cast<ps::list&>(static_cast<ps::list const&>(arg)).value();
+        if constexpr (std::same_as<std::remove_const_t<element>, ps::value>) {
+            static_assert(std::is_const_v<element>, "lists can only be passed as a span of const values");
+            // elements are already stored contiguously
+            return U { list.representation() };
+        } else {
+            return list_view<element> { list };
+        }
+    } else if constexpr (storage_type<U>) {
+        return static_cast<U const&>(arg);
+    } else {
+        return static_cast<typename storage_of<U>::type const&>(arg).value();
+    }
+}
+
+/**
+ * @brief Converts an argument of a call to a batch function to a parameter of type T. A std::span<T const> parameter receives
+ *        the elements of a list, or count copies of a single value. Other parameters are passed like in a normal external call.
+ */
+template<typename T>
+decltype(auto) batch_argument(ps::value const& arg, std::size_t count) {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (is_span<U>::value) {
+        using element = typename U::element_type;
+        static_assert(std::is_const_v<element>, "inputs of batch functions must be spans of const elements");
+        if (arg.get_type() == ps::type::list) {
+            auto& list = const_cast<ps::list&>(static_cast<ps::list const&>(arg)).value();
+            return list_view<element> { list };
+        }
+        return list_view<element> { to_element<std::remove_const_t<element>>(arg), count };
+    } else {
+        return extern_argument<T>(arg);
+    }
+}
+
+/**
+ * @brief Called by asynchronous external functions before waiting for their result. When the script runs through a ps::execution,
+ *        this suspends it until ready() returns true, so the host can continue. Otherwise this does nothing, and the caller blocks
+ *        while waiting for the result. Defined in execution.cpp.
+ */
+void suspend_until(std::function<bool()> const& ready);
+
+/**
+ * @brief Converts the result of an external call back to a value. A std::future is waited for first, see suspend_until().
+ */
+template<typename T>
+ps::value extern_result(ps::memory_pool& memory, T&& result) {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (is_future<U>::value) {
+        ps::suspend_until([&result] { return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+        if constexpr (std::is_void_v<decltype(result.get())>) {
+            result.get();
+            return ps::value::null();
+        } else {
+            return extern_result(memory, result.get());
+        }
+    } else if constexpr (std::same_as<U, ps::value>) {
+        return std::forward<T>(result);
+    } else if constexpr (std::same_as<U, bool>) {
+        return ps::value::from(memory, result);
+    } else if constexpr (std::is_floating_point_v<U>) {
+        return ps::value::from(memory, static_cast<float>(result));
+    } else if constexpr (std::is_integral_v<U> && std::is_unsigned_v<U>) {
+        return ps::value::from(memory, static_cast<unsigned int>(result));
+    } else if constexpr (std::is_integral_v<U>) {
+        return ps::value::from(memory, static_cast<int>(result));
+    } else if constexpr (storage_type<U>) {
+        return ps::value::from(memory, result.value());
+    } else {
+        return ps::value::from(memory, result);
+    }
+}
+
+/**
+ * @brief Type erased C++ function that can be called from a script with any amount of arguments.
+ *        Arguments are passed as a span, and unpacked into the parameters of the function by an adapter generated for its signature,
+ *        so calling it never allocates.
+ */
+class extern_function {
+public:
+    /**
+     * @brief Create an external function from a function pointer or a callable object with a single call operator.
+     *        Parameters can be arithmetic types, ps::value, storage types like ps::str, types like ps::string_type
+     *        taken by value or by reference to const, native structs, or spans of list elements.
+     *        A function that returns a std::future is asynchronous, see suspend_until().
+     */
+    template<typename C> requires (!std::same_as<std::decay_t<C>, extern_function>)
+    explicit extern_function(C&& callable)
+        : object(new std::decay_t<C>(std::forward<C>(callable)), &destroy<std::decay_t<C>>),
+          thunk(&invoke<std::decay_t<C>>),
+          param_count(callable_traits<std::decay_t<C>>::arity),
+          param_types(signature<typename callable_traits<std::decay_t<C>>::argument_types, false>::parameters.data()),
+          param_layouts(signature<typename callable_traits<std::decay_t<C>>::argument_types, false>::layouts.data()),
+          return_type(extern_type<typename callable_traits<std::decay_t<C>>::result_type>()) {
+
+    }
+
+    /**
+     * @brief Create a batch function from a kernel that processes many elements in a single call.
+     *        The script declares the function for a single element, and can call it with lists instead of values to apply it to
+     *        every element at once. Parameters of the kernel are:
+     *        - std::span<T const>: one value per element. Receives the elements of a list, or copies of a single value.
+     *        - other parameters: the same value for every element, passed like in a normal external call.
+     *        - optionally a last std::span<R> parameter, for the result of every element.
+     *        If any argument is a list, all lists must have the same size, and the result is a list with the result of every element.
+     *        Otherwise, the kernel is called for a single element and its result is returned directly.
+     */
+    template<typename C>
+    [[nodiscard]] static extern_function batch(C&& kernel) {
+        using traits = callable_traits<std::decay_t<C>>;
+        static_assert(std::is_void_v<typename traits::result_type>, "batch kernels return their results through a span parameter");
+        using params = typename traits::argument_types;
+        constexpr bool has_output = batch_has_output<C>();
+        ps::type result = ps::type::null;
+        if constexpr (has_output) result = batch_type<std::tuple_element_t<traits::arity - 1, params>>();
+        return extern_function { new std::decay_t<C>(std::forward<C>(kernel)), &destroy<std::decay_t<C>>, &invoke_batch<std::decay_t<C>>,
+                                 traits::arity - (has_output ? 1 : 0), signature<params, true>::parameters.data(),
+                                 signature<params, true>::layouts.data(), result };
+    }
+
+    extern_function(extern_function&&) noexcept = default;
+    extern_function& operator=(extern_function&&) noexcept = default;
+
+    /**
+     * @brief Call the function.
+     * @param memory Memory to create the returned value in.
+     * @param args Arguments of the call, one for every parameter.
+     * @throws std::runtime_error if the amount of arguments does not match the amount of parameters.
+     */
+    ps::value call(ps::memory_pool& memory, std::span<ps::value const> args) const;
+
+    /**
+     * @brief Get the amount of parameters of the function.
+     */
+    [[nodiscard]] std::size_t arity() const noexcept;
+
+    /**
+     * @brief Get the script type matching every parameter of the C++ function (for batch functions, of a single element).
+     *        ps::type::any is used for parameters that accept any value.
+     */
+    [[nodiscard]] std::span<ps::type const> parameter_types() const noexcept;
+
+    /**
+     * @brief Get the layout of the native struct every parameter takes (directly or as a span of them), or null for parameters
+     *        that do not take a native struct.
+     */
+    [[nodiscard]] std::span<ps::struct_layout const* const> parameter_layouts() const noexcept;
+
+    /**
+     * @brief Get the script type matching the return type of the C++ function, ps::type::null if it returns nothing.
+     */
+    [[nodiscard]] ps::type result_type() const noexcept;
+
+private:
+    using thunk_type = ps::value(*)(void* object, ps::memory_pool& memory, std::span<ps::value const> args);
+
+    // parameter types of a signature, generated at compile time.
+    template<typename Params, bool batch>
+    struct signature;
+
+    template<typename... Args, bool batch>
+    struct signature<std::tuple<Args...>, batch> {
+        // never empty, so data() always points to a valid array
+        static constexpr std::array<ps::type, sizeof...(Args) + 1> parameters { (batch ? batch_type<Args>() : extern_type<Args>())..., ps::type::null };
+        static constexpr std::array<ps::struct_layout const*, sizeof...(Args) + 1> layouts { layout_of<Args>()..., nullptr };
+    };
+
+    template<typename C>
+    static void destroy(void* object) {
+        delete static_cast<C*>(object);
+    }
+
+    template<typename C>
+    static ps::value invoke(void* object, ps::memory_pool& memory, std::span<ps::value const> args) {
+        using traits = callable_traits<C>;
+        return [&]<std::size_t... I>(std::index_sequence<I...>) {
+            C& callable = *static_cast<C*>(object);
+            if constexpr (std::is_void_v<typename traits::result_type>) {
+                std::invoke(callable, extern_argument<std::tuple_element_t<I, typename traits::argument_types>>(args[I])...);
+                return ps::value::null();
+            } else {
+                return extern_result(memory, std::invoke(callable, extern_argument<std::tuple_element_t<I, typename traits::argument_types>>(args[I])...));
+            }
+        }(std::make_index_sequence<traits::arity> {});
+    }
+
+    template<typename C>
+    static constexpr bool batch_has_output() {
+        using params = typename callable_traits<std::decay_t<C>>::argument_types;
+        if constexpr (std::tuple_size_v<params> == 0) {
+            return false;
+        } else {
+            using last = std::remove_cvref_t<std::tuple_element_t<std::tuple_size_v<params> - 1, params>>;
+            if constexpr (is_span<last>::value) return !std::is_const_v<typename last::element_type>;
+            else return false;
+        }
+    }
+
+    template<typename C>
+    static ps::value invoke_batch(void* object, ps::memory_pool& memory, std::span<ps::value const> args) {
+        using params = typename callable_traits<C>::argument_types;
+        constexpr bool has_output = batch_has_output<C>();
+        constexpr std::size_t inputs = std::tuple_size_v<params> - (has_output ? 1 : 0);
+
+        // all lists are processed together, so they must have the same size
+        bool batched = false;
+        std::size_t count = 1;
+        for (ps::value const& arg : args) {
+            if (arg.get_type() != ps::type::list) continue;
+            std::size_t const size = static_cast<ps::list const&>(arg)->size();
+            if (batched && size != count) throw std::runtime_error("In call to batch function: all lists must have the same size.");
+            batched = true;
+            count = size;
+        }
+
+        return [&]<std::size_t... I>(std::index_sequence<I...>) {
+            C& kernel = *static_cast<C*>(object);
+            if constexpr (has_output) {
+                using output = typename std::remove_cvref_t<std::tuple_element_t<inputs, params>>::element_type;
+                std::vector<output> results(count);
+                std::invoke(kernel, batch_argument<std::tuple_element_t<I, params>>(args[I], count)..., std::span<output> { results });
+                if (!batched) return extern_result(memory, results.front());
+
+                std::vector<ps::value> values {};
+                values.reserve(count);
+                for (output const& result : results) values.push_back(extern_result(memory, result));
+                return ps::value::from(memory, ps::list_type { values });
+            } else {
+                std::invoke(kernel, batch_argument<std::tuple_element_t<I, params>>(args[I], count)...);
+                return ps::value::null();
+            }
+        }(std::make_index_sequence<inputs> {});
+    }
+
+    extern_function(void* object, void(*destroy)(void*), thunk_type thunk, std::size_t param_count, ps::type const* param_types,
+                    ps::struct_layout const* const* param_layouts, ps::type return_type)
+        : object(object, destroy), thunk(thunk), param_count(param_count), param_types(param_types), param_layouts(param_layouts),
+          return_type(return_type) {
+
+    }
+
+    std::unique_ptr<void, void(*)(void*)> object;
+    thunk_type thunk = nullptr;
+    std::size_t param_count = 0;
+    ps::type const* param_types = nullptr;
+    ps::struct_layout const* const* param_layouts = nullptr;
+    ps::type return_type = ps::type::null;
+};
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <pscript/context.hpp>
+#include <pscript/perfect_hash.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ps {
+
+/**
+ * @brief Extern library that flattens a chain of extern libraries into a single table, created by extern_library_chain_builder::build().
+ *        When libraries in the chain define the same name, the one that comes first in the chain is used. Finding a function or variable
+ *        probes the table once, no matter how many libraries are in the chain.
+ *        The table is built once from extern_library::enumerate(). Names that are not in the table are looked up in the libraries of the
+ *        chain through get_function() and get_variable(), so libraries that only override those, and functions or variables added after
+ *        building, are still found, only without the single probe.
+ */
+class extern_registry : public extern_library {
+public:
+    /**
+     * @brief Flatten a chain of extern libraries. The registry takes ownership of the chain, since the table refers to its functions and variables.
+     * @param chain First library in the chain, may be null.
+     */
+    explicit extern_registry(std::unique_ptr<extern_library> chain);
+
+    /**
+     * @brief Find a function in the flattened chain, then in the libraries of the chain, then in the functions added to the registry itself.
+     */
+    ps::extern_function const* get_function(std::string const& name) override;
+
+    /**
+     * @brief Find a variable in the flattened chain, then in the libraries of the chain, then in the variables added to the registry itself.
+     */
+    void* get_variable(std::string const& name) override;
+
+    void enumerate(std::function<void(std::string const&, ps::extern_function const*)> const& on_function,
+                   std::function<void(std::string const&, void*)> const& on_variable) const override;
+
+private:
+    std::unique_ptr<extern_library> libraries = nullptr;
+
+    ps::perfect_hash function_names {};
+    std::vector<ps::extern_function const*> functions {};
+
+    ps::perfect_hash variable_names {};
+    std::vector<void*> variables {};
+};
+
+}
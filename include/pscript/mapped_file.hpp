@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace ps {
+
+/**
+ * @brief Read-only view of the contents of a file. Large files are memory mapped, so their contents are never copied and
+ *        only the parts that are used are read from disk. Small files are read into memory instead, since mapping them is slower.
+ *        A mapped file must not be truncated while it is mapped, and changes to it may be visible through the mapping.
+ */
+class mapped_file {
+public:
+    /**
+     * @brief Files of at least this size (in bytes) are memory mapped.
+     */
+    static constexpr std::size_t mapping_threshold = 64 * 1024;
+
+    /**
+     * @brief Create an empty file view.
+     */
+    mapped_file() = default;
+
+    /**
+     * @brief Open a file.
+     * @param path Path to the file.
+     * @throws std::runtime_error if the file cannot be opened or mapped.
+     */
+    explicit mapped_file(std::filesystem::path const& path);
+
+    mapped_file(mapped_file const&) = delete;
+    mapped_file& operator=(mapped_file const&) = delete;
+    mapped_file(mapped_file&& rhs) noexcept;
+    mapped_file& operator=(mapped_file&& rhs) noexcept;
+
+    ~mapped_file();
+
+    /**
+     * @brief Get the contents of the file. The view is invalidated when this object is moved or destroyed.
+     */
+    [[nodiscard]] std::string_view contents() const noexcept;
+
+    /**
+     * @brief Check if the file is memory mapped, instead of read into memory.
+     */
+    [[nodiscard]] bool is_mapped() const noexcept;
+
+private:
+    void unmap() noexcept;
+
+    // contents of files that are not mapped
+    std::string buffer {};
+    void const* mapping = nullptr;
+    std::size_t mapping_size = 0;
+};
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <pscript/script.hpp>
+#include <pscript/thread_pool.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ps {
+
+/**
+ * @brief Process-wide cache of parsed module scripts, shared by all contexts. Safe to use from multiple threads.
+ *        Cached scripts are immutable, importing a module in a context only executes its definitions.
+ */
+class module_cache {
+public:
+    /**
+     * @brief Get the global module cache.
+     */
+    [[nodiscard]] static module_cache& global();
+
+    /**
+     * @brief Find the source file of a module, by looking for it in each module path in order.
+     *        Found modules are remembered per list of module paths, so each module is only searched for once.
+     * @param module Dotted module name, for example std.io.
+     * @param module_paths Directories to search in.
+     * @return Canonical path to the module's source file, or an empty string if the module was not found.
+     */
+    [[nodiscard]] std::string resolve(std::string const& module, std::vector<std::string> const& module_paths);
+
+    /**
+     * @brief Get the parsed script of a module file. The file is only read and parsed if it is not in the cache yet,
+     *        or if its modification time or size changed since it was cached.
+     *        A precompiled version of the module (see script::save()) is used if there is one next to the source file
+     *        with the same name and a .psc extension, and it is not older than the source.
+     * @param filepath Path to the module's source file.
+     * @param ctx Context used to parse the module.
+     * @return The parsed module, or nullptr if the file does not exist.
+     */
+    [[nodiscard]] std::shared_ptr<ps::script const> load(std::string const& filepath, ps::context& ctx);
+
+    /**
+     * @brief Load all modules a script imports directly or indirectly that are not in the cache yet.
+     *        The import graph is discovered one level at a time, and all modules of a level are parsed in parallel
+     *        by the threads of the cache, which are reused for every preload.
+     *        Modules that cannot be found or parsed are skipped, so the import itself reports the error.
+     * @param script Script to load the imports of.
+     * @param module_paths Directories to search for modules in.
+     * @param ctx Context used to parse the modules.
+     */
+    void preload(ps::script const& script, std::vector<std::string> const& module_paths, ps::context& ctx);
+
+    /**
+     * @brief Remove all modules and resolved module paths from the cache. Contexts that imported a module keep it alive until they are reset or destroyed.
+     */
+    void clear();
+
+private:
+    module_cache() = default;
+
+    struct entry {
+        std::filesystem::file_time_type write_time {};
+        std::uintmax_t size = 0;
+        std::shared_ptr<ps::script const> script = nullptr;
+    };
+
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, entry> modules {};
+    // module paths + module name -> canonical file path
+    std::unordered_map<std::string, std::string> resolved_paths {};
+
+    // parses modules in preload(). Every worker compiles the grammar once, and keeps it for later preloads.
+    ps::thread_pool pool {};
+};
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <pscript/value.hpp>
+
+#include <concepts>
+#include <span>
+#include <string_view>
+
+namespace ps {
+
+/**
+ * @brief Binds a C++ struct to a struct declared in a script, so external functions can take it as a parameter, or take a list
+ *        of it as a std::span. Specialize this for the C++ struct with a static name (the name of the script struct, including
+ *        the module it was declared in, for example imgui.PlotPoint) and a static fields tuple created with ps::field():
+ *
+ *        template<>
+ *        struct ps::native_layout<Point> {
+ *            static constexpr std::string_view name = "Point";
+ *            static constexpr auto fields = std::tuple { ps::field("x", &Point::x), ps::field("y", &Point::y) };
+ *        };
+ *
+ *        Every field of the script struct must be listed with a matching arithmetic type. This is checked when an external function
+ *        that uses the struct is bound.
+ */
+template<typename T>
+struct native_layout;
+
+/**
+ * @brief Field of a C++ struct bound to a field of a script struct, see native_layout.
+ */
+template<typename C, typename M>
+struct native_field {
+    std::string_view name;
+    M C::* member;
+};
+
+template<typename C, typename M>
+constexpr native_field<C, M> field(std::string_view name, M C::* member) {
+    static_assert(std::is_arithmetic_v<M>, "fields of native structs must have an arithmetic type");
+    return native_field<C, M> { name, member };
+}
+
+/**
+ * @brief C++ structs that have a native_layout.
+ */
+template<typename T>
+concept native_struct = requires {
+    { native_layout<T>::name } -> std::convertible_to<std::string_view>;
+    native_layout<T>::fields;
+};
+
+/**
+ * @brief Layout of a native struct, used to check it against the script struct it is bound to.
+ */
+struct struct_layout {
+    struct field_info {
+        std::string_view name;
+        ps::type type;
+    };
+
+    std::string_view name;
+    std::span<field_info const> fields;
+};
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <pscript/syntax_tree.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <string_view>
+
+namespace ps {
+
+/**
+ * @brief Parser implementation used to parse scripts.
+ */
+enum class parser_backend {
+    // cpp-peglib, generated from the grammar in context.cpp.
+    peglib,
+    // Hand-written recursive descent parser for the same grammar. Much faster, and safe to use from multiple threads.
+    native
+};
+
+/**
+ * @brief Controls how much a parser memoizes (packrat parsing). Memoizing avoids parsing the same rule at the same position
+ *        twice when backtracking, at the cost of memory.
+ */
+enum class packrat_mode {
+    // Never memoize. Uses the least memory, but nested expressions can take exponential time to parse.
+    off,
+    // Memoize every rule at every position. Parsing takes linear time, but memory grows with the size of the source times the amount of rules.
+    on,
+    // peglib: packrat parsing for sources up to adaptive_packrat_limit bytes, larger sources are parsed without it.
+    // native: only the rules that are retried when backtracking are memoized, in a small cache of fixed size.
+    adaptive
+};
+
+/**
+ * @brief Largest source (in bytes) that peglib parses with packrat parsing in packrat_mode::adaptive.
+ */
+inline constexpr std::size_t adaptive_packrat_limit = 256 * 1024;
+
+/**
+ * @brief Statistics about parsing a script, see script::stats().
+ */
+struct parse_stats {
+    // time spent parsing, including building the syntax tree and resolving symbols
+    std::chrono::nanoseconds time {};
+    // whether memoization was used at all
+    bool packrat = false;
+    // native: amount of results stored in the memo tables.
+    // peglib: amount of rule and position pairs in its memo tables, as peglib does not report how many of them it filled.
+    std::size_t memo_entries = 0;
+    // estimated peak memory used while parsing (memo tables, intermediate nodes and the syntax tree)
+    std::size_t peak_bytes = 0;
+};
+
+/**
+ * @brief Parse a script with the native parser.
+ *        The resulting AST is identical to the optimized AST peglib produces for the same source, including line and column information.
+ *        Symbols and literals are not resolved yet.
+ * @param source Source code to parse. Tokens in the AST point into this string, so it must outlive the AST.
+ * @param packrat Which rules are memoized.
+ * @param stats If not null, receives the amount of memo entries and memory used. The time is left untouched.
+ * @return The AST, or an empty tree if the source contains a syntax error.
+ */
+[[nodiscard]] ps::syntax_tree parse_native(std::string_view source, ps::packrat_mode packrat = ps::packrat_mode::adaptive,
+                                          ps::parse_stats* stats = nullptr);
+
+}
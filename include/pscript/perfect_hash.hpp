@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ps {
+
+/**
+ * @brief Immutable set of strings that maps every string to its index, built so that finding a string always probes exactly one slot.
+ *        Uses hash and displace: strings are first grouped in buckets, and every bucket stores a seed that places its strings
+ *        in free slots without collisions. Building is slower than inserting into a std::unordered_map, so this is meant for
+ *        tables that are built once and searched often.
+ */
+class perfect_hash {
+public:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    /**
+     * @brief Create an empty table.
+     */
+    perfect_hash() = default;
+
+    /**
+     * @brief Build a table of strings.
+     * @param keys Strings to store, which must all be different.
+     * @throws std::runtime_error if the same string is passed more than once.
+     */
+    explicit perfect_hash(std::vector<std::string> keys);
+
+    /**
+     * @brief Find a string.
+     * @return Index of the string in the keys the table was built from, or npos if it is not in the table.
+     */
+    [[nodiscard]] std::size_t find(std::string_view key) const noexcept;
+
+    /**
+     * @brief Get the amount of strings in the table.
+     */
+    [[nodiscard]] std::size_t size() const noexcept;
+
+private:
+    // seed of every bucket, the amount of buckets is a power of two.
+    std::vector<std::uint32_t> seeds {};
+    // index + 1 of the key stored in every slot, or 0 for free slots. The amount of slots is a power of two.
+    std::vector<std::uint32_t> slots {};
+    std::vector<std::string> keys {};
+};
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <pscript/context.hpp>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace ps {
+
+/**
+ * @brief Incremental input handling for interactive mode. Lines are collected until they form a complete chunk
+ *        (balanced brackets, ending in ';' or '}'), which is then parsed and executed on its own. Earlier input is never parsed again.
+ *        A chunk that ends in an if statement is executed when the next line is added, unless that line starts with else,
+ *        which continues the chunk instead. An empty line executes it right away.
+ */
+class repl {
+public:
+    /**
+     * @brief Create an interactive session.
+     * @param ctx Context to execute input in. Must outlive the session.
+     * @param exec Execution context used for every chunk.
+     */
+    explicit repl(ps::context& ctx, ps::execution_context exec = {});
+
+    /**
+     * @brief Add a line of input. If this completes a chunk, it is executed.
+     * @param line Line of input, without the trailing newline.
+     * @return True if a chunk was executed.
+     */
+    bool feed(std::string_view line);
+
+    /**
+     * @brief Execute a chunk that ends in an if statement and is still waiting to see if an else follows. Call this when the input ends.
+     * @return True if a chunk was executed.
+     */
+    bool flush();
+
+    /**
+     * @brief Check if the session is waiting for more lines to complete a chunk.
+     */
+    [[nodiscard]] bool pending() const noexcept;
+
+    /**
+     * @brief Discard input that does not form a complete chunk yet.
+     */
+    void clear() noexcept;
+
+    /**
+     * @brief Get the amount of parsed chunks that are still alive. A chunk stays alive as long as a function defined in it
+     *        has not been redefined, other chunks are released right after executing them.
+     */
+    [[nodiscard]] std::size_t parsed_chunks() const noexcept;
+
+private:
+    // last_statement is set to the offset of the last top level statement in the buffer.
+    [[nodiscard]] bool is_complete(std::size_t& last_statement) const noexcept;
+    void execute_buffer();
+
+    ps::context& ctx;
+    ps::execution_context exec;
+    std::string buffer {};
+    // the buffer is a complete chunk ending in an if statement, see feed()
+    bool awaiting_else = false;
+
+    // Parsed chunks by source. Entering the same chunk again while it is still alive reuses it instead of parsing it again.
+    std::unordered_map<std::string, std::weak_ptr<ps::script>> parsed {};
+};
+
+}
@@ -1,37 +1,97 @@
 #pragma once
 
+#include <pscript/mapped_file.hpp>
+#include <pscript/parser.hpp>
+#include <pscript/symbol.hpp>
+#include <pscript/syntax_tree.hpp>
+
+#include <cstdint>
+#include <iosfwd>
 #include <string>
+#include <string_view>
 #include <memory>
-
-namespace peg {
-    class parser;
-    struct EmptyType;
-    template<typename> struct AstBase;
-    using Ast = AstBase<EmptyType>;
-}
+#include <vector>
 
 namespace ps {
 
-using Ast = peg::AstBase<peg::EmptyType>;
-
 class context;
 
 class script {
 public:
-    // TODO: Add constructor from binary_input_stream maybe?
+    /**
+     * @brief Version of the precompiled script format written by save(). Precompiled scripts with a different version cannot be loaded.
+     */
+    static constexpr std::uint32_t binary_version = 2;
+
     explicit script(std::string source, ps::context& ctx);
 
+    /**
+     * @brief Parse a script from a file. Tokens point directly into the file contents, so a memory mapped file is never copied.
+     * @param source File to parse, the script takes ownership of it.
+     * @param ctx Context used to parse the script.
+     */
+    explicit script(ps::mapped_file source, ps::context& ctx);
+
+    /**
+     * @brief Load a precompiled script written by save(). This does not parse the source again.
+     * @param in Stream to read from, opened in binary mode.
+     * @throws std::runtime_error if the data is not a valid precompiled script of the current version.
+     */
+    explicit script(std::istream& in);
+
+    // Tokens in the AST point into the source string, so a script can never be copied or moved.
+    // Use a std::shared_ptr<ps::script> to share a script instead.
+    script(script const&) = delete;
+    script(script&&) = delete;
+    script& operator=(script const&) = delete;
+    script& operator=(script&&) = delete;
+
     /**
      * @brief Get source code of the script
      */
-    [[nodiscard]] std::string const& source() const;
+    [[nodiscard]] std::string_view source() const;
+
+    /**
+     * @brief Get the root node of the AST, or nullptr if the script has a syntax error.
+     */
+    [[nodiscard]] ps::ast_node const* ast() const;
+
+    /**
+     * @brief Get the AST with all its nodes.
+     */
+    [[nodiscard]] ps::syntax_tree const& tree() const;
 
-    [[nodiscard]] std::shared_ptr<ps::Ast> const& ast() const;
+    /**
+     * @brief Get the modules imported anywhere in this script, as dotted module names (for example std.io), in the order they appear.
+     */
+    [[nodiscard]] std::vector<std::string> const& imports() const;
+
+    /**
+     * @brief Get statistics about parsing this script. All zero for scripts loaded from the precompiled format.
+     */
+    [[nodiscard]] ps::parse_stats const& stats() const;
+
+    /**
+     * @brief Write this script in the precompiled format, to be loaded later with script(std::istream&).
+     *        The format stores the source, the optimized AST with line and column information, and the names and
+     *        string literals it references.
+     * @param out Stream to write to, opened in binary mode.
+     */
+    void save(std::ostream& out) const;
 
 private:
+    void parse(ps::context& ctx);
+
+    // source is either stored in a string or in a file
     std::string original_source {};
+    ps::mapped_file file {};
+    std::string_view source_text {};
+
+    ps::syntax_tree syntax {};
+
+    std::vector<std::string> imported_modules {};
 
-    std::shared_ptr<ps::Ast> peg_ast {};
+    ps::parse_stats statistics {};
 };
 
 }
\ No newline at end of file
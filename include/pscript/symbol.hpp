@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace ps {
+
+/**
+ * @brief Interned name. Two symbols are equal if and only if the names they were interned from are equal.
+ */
+using symbol = std::uint32_t;
+constexpr symbol null_symbol = 0;
+
+/**
+ * @brief Symbols for names the interpreter needs to recognize (builtin and member functions).
+ *        These are interned in this exact order when the symbol table is created, so they can be compared against directly.
+ */
+namespace symbols {
+    constexpr symbol ref = 1;
+    constexpr symbol print = 2;
+    constexpr symbol readln = 3;
+    constexpr symbol time = 4;
+    constexpr symbol dump = 5;
+    constexpr symbol append = 6;
+    constexpr symbol size = 7;
+    constexpr symbol format = 8;
+    constexpr symbol parse_int = 9;
+    constexpr symbol parse_float = 10;
+}
+
+/**
+ * @brief Process-wide table mapping names to symbols. Safe to use from multiple threads.
+ */
+class symbol_table {
+public:
+    /**
+     * @brief Get the global symbol table.
+     */
+    [[nodiscard]] static symbol_table& global();
+
+    /**
+     * @brief Get the symbol for a name, creating it if it did not exist yet.
+     * @param name Name to intern.
+     * @return Symbol identifying this name.
+     */
+    [[nodiscard]] ps::symbol intern(std::string_view name);
+
+    /**
+     * @brief Get the symbol for a name without creating it.
+     * @param name Name to look up.
+     * @return Symbol identifying this name, or null_symbol if the name was never interned.
+     */
+    [[nodiscard]] ps::symbol find(std::string_view name) const;
+
+    /**
+     * @brief Get the name a symbol was created from.
+     * @param sym Valid symbol.
+     * @return Reference to the name. This reference stays valid for the lifetime of the program.
+     */
+    [[nodiscard]] std::string const& name(ps::symbol sym) const;
+
+private:
+    symbol_table();
+
+    mutable std::shared_mutex mutex;
+    // std::deque never moves its elements when growing at the end, so string views into it stay valid.
+    std::deque<std::string> names {};
+    std::unordered_map<std::string_view, ps::symbol> lookup {};
+};
+
+/**
+ * @brief Shorthand for symbol_table::global().intern(name).
+ */
+[[nodiscard]] ps::symbol intern(std::string_view name);
+
+/**
+ * @brief Shorthand for symbol_table::global().name(sym).
+ */
+[[nodiscard]] std::string const& symbol_name(ps::symbol sym);
+
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <pscript/symbol.hpp>
+
+#include <charconv>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace ps {
+
+/**
+ * @brief Node in the AST of a script. Nodes live in the node array of a ps::syntax_tree, and the children of a node are
+ *        stored next to each other in that array, so they can be reached without following pointers.
+ */
+struct ast_node {
+    // Kind of the node, this is the tag of the grammar rule that created it (compare with "rule_name"_ from peg::udl).
+    unsigned int tag = 0;
+    // When nodes with a single child are collapsed, the child takes their place. This is the kind of the outermost node it replaced,
+    // or the same as tag if it did not replace anything.
+    unsigned int original_tag = 0;
+    // Children are stored starting at this + first_child.
+    std::uint32_t first_child = 0;
+    std::uint32_t child_count = 0;
+    // Position in the source, both start at 1. Columns count code points.
+    std::uint32_t line = 0;
+    std::uint32_t column = 0;
+    // Interned token for identifiers and identifier operands.
+    // For call expressions and typenames this is the fully qualified name (e.g. std.io.print), for namespace lists
+    // this is the namespace (e.g. std.io).
+    ps::symbol sym = ps::null_symbol;
+    bool is_token = false;
+    // Matched text of a token, points into the source of the script.
+    std::string_view token {};
+    // Contents of a string literal operand (without quotes). Strings created from this literal share this data.
+    std::shared_ptr<std::string const> const* literal = nullptr;
+
+    [[nodiscard]] std::span<ast_node const> nodes() const noexcept {
+        return { this + first_child, child_count };
+    }
+
+    [[nodiscard]] std::string token_to_string() const {
+        return std::string(token);
+    }
+
+    template<typename T>
+    [[nodiscard]] T token_to_number() const {
+        T value {};
+        if constexpr (std::is_floating_point_v<T>) {
+            // floating point std::from_chars is not available everywhere yet
+            std::istringstream stream { token_to_string() };
+            stream >> value;
+        } else {
+            std::from_chars(token.data(), token.data() + token.size(), value);
+        }
+        return value;
+    }
+};
+
+/**
+ * @brief Flattened AST of a script. All nodes are stored in one array in breadth first order, starting with the root node.
+ */
+class syntax_tree {
+public:
+    syntax_tree() = default;
+
+    // Nodes point to literals stored in the tree, moving keeps them in place but copying would not.
+    syntax_tree(syntax_tree const&) = delete;
+    syntax_tree(syntax_tree&&) noexcept = default;
+    syntax_tree& operator=(syntax_tree const&) = delete;
+    syntax_tree& operator=(syntax_tree&&) noexcept = default;
+
+    /**
+     * @brief Get the root node, or nullptr if the tree is empty (for example because the source has a syntax error).
+     */
+    [[nodiscard]] ps::ast_node const* root() const noexcept;
+
+    /**
+     * @brief Get all nodes in the tree, in breadth first order.
+     */
+    [[nodiscard]] std::span<ps::ast_node const> nodes() const noexcept;
+
+    /**
+     * @brief Get all string literals referenced by nodes in this tree.
+     */
+    [[nodiscard]] std::deque<std::shared_ptr<std::string const>> const& literals() const noexcept;
+
+    /**
+     * @brief Get the amount of memory used by this tree in bytes, not counting the source it points into.
+     */
+    [[nodiscard]] std::size_t memory_usage() const noexcept;
+
+    /**
+     * @brief Add the root node to an empty tree.
+     * @return Index of the root node.
+     */
+    std::uint32_t add_root();
+
+    /**
+     * @brief Add all children of a node at once, so they are stored next to each other. Must be called in breadth first order.
+     * @param parent Index of the node to add children to.
+     * @param count Amount of children.
+     * @return Index of the first child.
+     */
+    std::uint32_t add_children(std::uint32_t parent, std::uint32_t count);
+
+    /**
+     * @brief Add nodes without connecting them to a parent, for when their offsets are already known (for example when loading
+     *        a precompiled script).
+     * @return Index of the first added node.
+     */
+    std::uint32_t add_nodes(std::uint32_t count);
+
+    /**
+     * @brief Get a node by index, to fill it in while building the tree. References are invalidated by adding nodes.
+     */
+    [[nodiscard]] ps::ast_node& node(std::uint32_t index) noexcept;
+
+    /**
+     * @brief Store a string literal in the tree.
+     * @return Pointer to assign to ps::ast_node::literal, valid for the lifetime of the tree.
+     */
+    std::shared_ptr<std::string const> const* add_literal(std::shared_ptr<std::string const> literal);
+
+    void reserve(std::size_t count);
+
+private:
+    std::vector<ps::ast_node> node_storage {};
+    // a deque never moves its elements, so nodes can point to them
+    std::deque<std::shared_ptr<std::string const>> literal_storage {};
+};
+
+}
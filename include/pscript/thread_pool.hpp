@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ps {
+
+/**
+ * @brief Fixed set of worker threads that are reused for every parallel loop, so running a loop never creates threads.
+ *        The threads are started on the first loop that has more than one iteration, and stopped when the pool is destroyed.
+ */
+class thread_pool {
+public:
+    /**
+     * @brief Create a pool.
+     * @param threads Amount of threads that run a loop, including the thread that calls parallel_for(). Defaults to the amount of cores.
+     */
+    explicit thread_pool(std::size_t threads = std::thread::hardware_concurrency());
+
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+
+    ~thread_pool();
+
+    /**
+     * @brief Call f(i) for every i in [0, count), spread over the threads of the pool. The calling thread also runs iterations,
+     *        and this returns once all of them are done. Can be called from multiple threads at once.
+     * @param f Function to call, must not throw.
+     */
+    void parallel_for(std::size_t count, std::function<void(std::size_t)> const& f);
+
+    /**
+     * @brief Get the amount of threads that run a loop, including the calling thread.
+     */
+    [[nodiscard]] std::size_t size() const noexcept;
+
+private:
+    struct job;
+
+    void work();
+    // runs iterations of a job until none are left, returns how many this thread ran.
+    static std::size_t run(job& j);
+
+    std::size_t thread_count = 1;
+
+    std::mutex mutex {};
+    std::condition_variable work_available {};
+    std::condition_variable job_done {};
+    // loops that still have iterations that were not started
+    std::deque<std::shared_ptr<job>> jobs {};
+    bool stopping = false;
+    std::vector<std::thread> workers {};
+};
+
+}
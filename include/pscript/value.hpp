@@ -1,9 +1,12 @@
 #pragma once
 
 #include <pscript/memory.hpp>
+#include <pscript/symbol.hpp>
 
 #include <plib/concepts.hpp>
 
+#include <array>
+#include <variant>
 #include <vector>
 #include <exception>
 #include <stdexcept>
@@ -14,6 +17,12 @@ namespace ps {
 
 class value;
 
+/**
+ * @brief Copies made while cloning, by the memory of the list or struct they copy. Data that several values share is copied once,
+ *        and the copies share it in the same way.
+ */
+using clone_map = std::unordered_map<ps::pointer, ps::value>;
+
 enum class type {
     null,
     any,
@@ -406,7 +415,8 @@ public:
     value& operator=(value const& rhs);
 
     value(value&& rhs) noexcept;
-    value& operator=(value&& rhs) noexcept;
+    // not noexcept: a value in host memory is written to like in a copy assignment, which throws if the types do not match.
+    value& operator=(value&& rhs);
 
     ~value();
 
@@ -425,6 +435,15 @@ public:
     // construct a value as a reference, regardless of its type.
     static ps::value ref(ps::value const& rhs);
 
+    /**
+     * @brief Creates a value that stores its data in memory owned by the host, used for extern variables of type int, uint, float and bool.
+     *        The memory is never freed, and assigning to the value writes to it, so the host and the script always see the same data.
+     *        Copies of the value are normal values.
+     * @param address Address of an int, unsigned int, float or bool matching the type.
+     * @param type Type of the value, must be an arithmetic type or boolean.
+     */
+    static ps::value host(ps::memory_pool& memory, void* address, ps::type type);
+
     ps::pointer pointer() const;
     type get_type() const;
 
@@ -453,6 +472,19 @@ public:
     template<typename T>
     T cast() const;
 
+    /**
+     * @brief Creates a deep copy of this value. Lists and structs are copied recursively, strings share their immutable data.
+     *        A list or struct that appears several times in this value is copied once, and shared by the copy in the same way.
+     *        A reference to a number is copied as the number it refers to. Values in host memory stay in host memory.
+     */
+    [[nodiscard]] ps::value clone() const;
+
+    /**
+     * @brief Creates a deep copy like clone(), but shares lists and structs that were already copied with the same map.
+     *        Used to copy several values that share data, such as all global variables of a context.
+     */
+    [[nodiscard]] ps::value clone(ps::clone_map& copies) const;
+
     // Effectively changes a value's type to a new type, but only if the cast is allowed.
     void cast_this(ps::type new_type);
 
@@ -462,6 +494,8 @@ public:
 
     inline bool is_reference() const { return is_ref; }
 
+    inline bool is_host() const { return in_host_memory; }
+
 private:
     mutable ps::memory_pool* memory = nullptr;
 
@@ -471,6 +505,8 @@ private:
     // if is_ref is true, but refcount is null, this is an uncounted reference and shouldn't be cleaned up;
     std::shared_ptr<int> refcount = nullptr;
     bool is_ref = false;
+    // if true, ptr points to memory owned by the host, see value::host().
+    bool in_host_memory = false;
 };
 
 
@@ -496,6 +532,9 @@ public:
 
     [[nodiscard]] inline std::vector<ps::value> const& representation() const { return storage; }
 
+    // Copies this list, cloning all elements. Elements that were already copied with the same map are shared instead.
+    [[nodiscard]] list_type clone(ps::clone_map& copies) const;
+
     template<typename T>
     explicit operator T() const {
         throw std::runtime_error("Invalid cast");
@@ -506,11 +545,20 @@ private:
     [[maybe_unused]] type stored_type {};
 };
 
+/**
+ * @brief Immutable string value. Short strings are stored inline, longer strings share their (immutable) data between copies.
+ *        Modifying a string never touches shared data, but creates new storage instead (copy-on-write).
+ */
 class string_type {
 public:
     string_type() = default;
 
     explicit string_type(std::string const& str);
+    /**
+     * @brief Create a string from a string literal. Copies of this string share the literal data instead of copying it.
+     * @param literal Literal data, usually owned by the script the literal was found in.
+     */
+    explicit string_type(std::shared_ptr<std::string const> literal);
     string_type(string_type const&) = default;
     string_type(string_type&&) noexcept = default;
     string_type& operator=(string_type const&) = default;
@@ -521,9 +569,21 @@ public:
     [[nodiscard]] int parse_int() const;
     [[nodiscard]] float parse_float() const;
 
+    /**
+     * @brief Appends to this string. Shared data is never modified, so other copies of this string are unaffected.
+     */
+    void append(std::string_view str);
+
     friend std::ostream& operator<<(std::ostream& out, string_type const& str);
 
-    [[nodiscard]] inline std::string const& representation() const { return storage; }
+    [[nodiscard]] std::string_view representation() const;
+
+    /**
+     * @brief Get a null-terminated pointer to the string data. This never allocates.
+     */
+    [[nodiscard]] char const* c_str() const;
+
+    [[nodiscard]] std::size_t size() const;
 
     template<typename T>
     explicit operator T() const {
@@ -531,14 +591,29 @@ public:
     }
 
 private:
-    std::string storage {};
+    // Strings up to this many characters are stored inline without allocating.
+    static constexpr std::size_t small_capacity = 22;
+
+    // no default member initializers, std::variant value-initializes (zeroes) these.
+    struct small_storage {
+        std::array<char, small_capacity + 1> data; // always null-terminated
+        std::uint8_t size;
+    };
+
+    struct shared_storage {
+        std::shared_ptr<std::string const> data;
+    };
+
+    std::variant<small_storage, shared_storage> storage {};
+
+    void assign(std::string_view str);
 };
 
 class struct_type {
 public:
     struct_type() = default;
     // name is used to identify different struct types
-    struct_type(std::string const& name, std::unordered_map<std::string, ps::value> const& initializers);
+    struct_type(ps::symbol name, std::unordered_map<ps::symbol, ps::value> const& initializers);
     struct_type(struct_type const&) = default;
     struct_type(struct_type&&) noexcept = default;
     struct_type& operator=(struct_type const&) = default;
@@ -549,7 +624,14 @@ public:
     [[nodiscard]] ps::value& access(std::string const& field_name);
     [[nodiscard]] ps::value const& access(std::string const& field_name) const;
 
+    [[nodiscard]] ps::value& access(ps::symbol field);
+    [[nodiscard]] ps::value const& access(ps::symbol field) const;
+
     [[nodiscard]] std::string const& type_name() const;
+    [[nodiscard]] ps::symbol type_symbol() const;
+
+    // Copies this struct, cloning all members. Members that were already copied with the same map are shared instead.
+    [[nodiscard]] struct_type clone(ps::clone_map& copies) const;
 
     friend std::ostream& operator<<(std::ostream& out, string_type const& str);
 
@@ -559,8 +641,8 @@ public:
     }
 
 private:
-    std::unordered_map<std::string, ps::value> members;
-    std::string name;
+    std::unordered_map<ps::symbol, ps::value> members;
+    ps::symbol name = ps::null_symbol;
 };
 
 struct external_type {
@@ -613,7 +695,9 @@ inline bool operator||(boolean const& lhs, boolean const &rhs) {
 
 // string concatenation
 inline string_type operator+(str const& lhs, str const& rhs) {
-    return string_type { lhs->representation() + rhs->representation() };
+    string_type result = lhs.value();
+    result.append(rhs->representation());
+    return result;
 }
 
 inline bool operator!(boolean const& lhs) {
@@ -0,0 +1,59 @@
+#include <pscript/context_pool.hpp>
+
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+namespace ch = std::chrono;
+
+// A small request-style script: import a module, do a little work, print the result.
+constexpr char const* request_source = R"(
+    import std.io;
+    import std.math;
+
+    let values = [3, 8, 1, 5];
+    let largest = 0;
+    for (let i = 0; i < values.size(); ++i) {
+        largest = std.math.max(largest, values[i]);
+    }
+    std.io.print(largest);
+)";
+
+constexpr std::size_t memsize = 1024 * 1024;
+
+// returns throughput in requests per second
+template<typename F>
+double bench_requests(std::size_t requests, F&& run_request) {
+    auto start = ch::high_resolution_clock::now();
+    for (std::size_t i = 0; i < requests; ++i) {
+        run_request();
+    }
+    auto end = ch::high_resolution_clock::now();
+    return requests / ch::duration<double>(end - start).count();
+}
+
+int main() {
+    constexpr std::size_t requests = 200;
+
+    std::ostringstream output {};
+    ps::execution_context exec {};
+    exec.out = &output;
+
+    double const new_context = bench_requests(requests, [&exec]() {
+        ps::context ctx(memsize);
+        ps::script script(request_source, ctx);
+        ctx.execute(script, exec);
+    });
+
+    ps::context_pool pool(memsize);
+    double const pooled_context = bench_requests(requests, [&exec, &pool]() {
+        auto ctx = pool.acquire();
+        ps::script script(request_source, *ctx);
+        ctx->execute(script, exec);
+    });
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Context setup\t\t||\t\tThroughput (requests/second)\n";
+    std::cout << "new context\t\t||\t\t" << new_context << std::endl;
+    std::cout << "context pool\t\t||\t\t" << pooled_context << std::endl;
+}
@@ -2,48 +2,73 @@
 
 #include <chrono>
 #include <filesystem>
-#include <fstream>
 #include <sstream>
 
 namespace ch = std::chrono;
 namespace fs = std::filesystem;
 
-// returns runtime in milliseconds
-float bench_script(std::string const& source, std::size_t iterations) {
-    ch::nanoseconds time {};
+// average times in milliseconds
+struct bench_result {
+    float parse = 0;
+    float restore = 0;
+    float run = 0;
+};
+
+static float average_ms(ch::nanoseconds time, std::size_t iterations) {
+    return time.count() / (iterations * 1000000.0f);
+}
+
+bench_result bench_script(fs::path const& path, std::size_t iterations) {
+    ch::nanoseconds parse_time {};
+    ch::nanoseconds restore_time {};
+    ch::nanoseconds run_time {};
     std::ostringstream output {};
     std::ostringstream error_output {};
+    ps::context ctx(16 * 1024 * 1024); // 16 MiB memory heap for benchmarks
+    ps::execution_context exec;
+    exec.out = &output;
+    exec.err = &error_output;
+
+    // import the modules the benchmark uses before taking the snapshot, so every iteration starts with them already imported.
+    ps::script script(ps::mapped_file(path), ctx);
+    std::string imports {};
+    for (auto const& module : script.imports()) {
+        imports += "import " + module + ";\n";
+    }
+    ps::script prelude(imports, ctx);
+    ctx.execute(prelude, exec);
+    auto const clean = ctx.snapshot();
+
     for (std::size_t i = 0; i < iterations; ++i) {
-        ps::context ctx(16 * 1024 * 1024); // 16 MiB memory heap for benchmarks
-        ps::script script(source, ctx);
-        ps::execution_context exec;
-        exec.out = &output;
-        exec.err = &error_output;
         auto start = ch::high_resolution_clock::now();
-        ctx.execute(script, exec);
+        ps::script parsed(ps::mapped_file(path), ctx);
         auto end = ch::high_resolution_clock::now();
-        time += ch::duration_cast<ch::nanoseconds>(end - start);
+        parse_time += ch::duration_cast<ch::nanoseconds>(end - start);
+
+        start = ch::high_resolution_clock::now();
+        ctx.restore(clean);
+        end = ch::high_resolution_clock::now();
+        restore_time += ch::duration_cast<ch::nanoseconds>(end - start);
+
+        start = ch::high_resolution_clock::now();
+        ctx.execute(parsed, exec);
+        end = ch::high_resolution_clock::now();
+        run_time += ch::duration_cast<ch::nanoseconds>(end - start);
     }
     if (!error_output.str().empty()) {
         std::cerr << error_output.str() << std::endl;
     }
-    return time.count() / (iterations * 1000000.0f);
-}
-
-
-std::string read_file(fs::path const& path) {
-    std::ifstream in { path };
-    return std::string { std::istreambuf_iterator{ in }, {} };
+    return { average_ms(parse_time, iterations), average_ms(restore_time, iterations), average_ms(run_time, iterations) };
 }
 
 int main() {
     constexpr std::size_t iterations = 50;
 
     std::cout << std::setprecision(4);
-    std::cout << "Benchmark\t\t||\t\tAverage runtime (milliseconds)\n";
+    std::cout << "Benchmark\t\t||\t\tAverage parse / restore / runtime (milliseconds)\n";
     for (auto const& entry : fs::directory_iterator("benchmarks/")) {
-        std::string source = read_file(entry.path());
-        auto average_runtime = bench_script(source, iterations);
-        std::cout << entry.path().stem().generic_string() << "\t\t||\t\t" << average_runtime << std::endl;
+        auto const average = bench_script(entry.path(), iterations);
+        std::cout << entry.path().stem().generic_string() << "\t\t||\t\t"
+                  << average.parse << " / " << average.restore << " / " << average.run << std::endl;
     }
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include <pscript/context.hpp>
+
+#include <chrono>
+#include <iomanip>
+#include <string>
+
+namespace ch = std::chrono;
+
+// Generates a large script by repeating a block of typical code with unique names.
+std::string generate_script(std::size_t blocks) {
+    std::string source = "import std.io;\n\n";
+    for (std::size_t i = 0; i < blocks; ++i) {
+        std::string const n = std::to_string(i);
+        source += "struct Point" + n + " {\n"
+                  "    x: float = 0.0;\n"
+                  "    y: float = 0.0;\n"
+                  "};\n\n"
+                  "fn compute" + n + "(a: int, b: int, values: list) -> int {\n"
+                  "    let total = 0;\n"
+                  "    for (let i = 0; i < values.size(); ++i) {\n"
+                  "        if (values[i] % 2 == 0) total += values[i] * a;\n"
+                  "        else total -= (values[i] + b) / 2;\n"
+                  "    }\n"
+                  "    while (total > 1000) {\n"
+                  "        total = total - 1000;\n"
+                  "    }\n"
+                  "    return total;\n"
+                  "}\n\n"
+                  "// call the function we just defined\n"
+                  "let p" + n + " = Point" + n + " { 1.0, 2.0 };\n"
+                  "std.io.print(compute" + n + "(" + n + ", 3, [1, 2, 3, 4, 5]));\n\n";
+    }
+    return source;
+}
+
+// returns throughput in MiB per second
+double bench_parse(std::string const& source, ps::parser_backend backend, std::size_t iterations) {
+    ps::context ctx(1024 * 1024, backend);
+    ch::nanoseconds time {};
+    for (std::size_t i = 0; i < iterations; ++i) {
+        auto start = ch::high_resolution_clock::now();
+        ps::script script(source, ctx);
+        auto end = ch::high_resolution_clock::now();
+        if (!script.ast()) {
+            std::cerr << "parse failed" << std::endl;
+            return 0.0;
+        }
+        time += ch::duration_cast<ch::nanoseconds>(end - start);
+    }
+    double const seconds = ch::duration<double>(time).count();
+    return (source.size() * iterations) / (seconds * 1024.0 * 1024.0);
+}
+
+int main() {
+    constexpr std::size_t iterations = 5;
+    std::string const source = generate_script(500);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Parsing " << source.size() / 1024 << " KiB of source\n";
+    std::cout << "Parser\t\t||\t\tThroughput (MiB/second)\n";
+    std::cout << "peglib\t\t||\t\t" << bench_parse(source, ps::parser_backend::peglib, iterations) << std::endl;
+    std::cout << "native\t\t||\t\t" << bench_parse(source, ps::parser_backend::native, iterations) << std::endl;
+
+    ps::context ctx(1024 * 1024, ps::parser_backend::native);
+    ps::script script(source, ctx);
+    std::cout << "AST: " << script.tree().nodes().size() << " nodes, " << script.tree().memory_usage() / 1024 << " KiB" << std::endl;
+}
@@ -1,23 +1,25 @@
 #include <filesystem>
 #include <iostream>
-#include <fstream>
+#include <stdexcept>
 #include <string>
 
 #include <pscript/context.hpp>
+#include <pscript/repl.hpp>
 
 namespace fs = std::filesystem;
 
 int run_from_file(fs::path const& file, std::size_t memory) {
     ps::context ctx(memory);
 
-    std::ifstream in { file };
-    if (!in.good()) {
+    ps::mapped_file source {};
+    try {
+        source = ps::mapped_file(file);
+    } catch (std::runtime_error const&) {
         std::cerr << "Failed to open file " << file << std::endl;
         return -1;
     }
 
-    std::string source { std::istreambuf_iterator<char>{in}, {} };
-    ps::script script(source, ctx);
+    ps::script script(std::move(source), ctx);
 
     ctx.execute(script);
 
@@ -26,16 +28,18 @@ int run_from_file(fs::path const& file, std::size_t memory) {
 
 int run_interactive(std::size_t memory) {
     ps::context ctx(memory);
+    ps::repl repl(ctx);
     std::cout << "====================== Pscript interactive tool ======================\n";
     while(true) {
-        std::cout << ">>> " << std::flush;
+        // continuation prompt while a multi-line chunk is incomplete
+        std::cout << (repl.pending() ? "... " : ">>> ") << std::flush;
         std::string input {};
-        std::getline(std::cin, input);
+        if (!std::getline(std::cin, input)) break;
         if (input == "quit") break;
 
-        std::shared_ptr<ps::script> script = std::make_shared<ps::script>(input, ctx);
-        ctx.execute(script);
+        repl.feed(input);
     }
+    repl.flush();
 
     return 0;
 }
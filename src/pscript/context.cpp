@@ -2,10 +2,14 @@
 #pragma ide diagnostic ignored "misc-no-recursion"
 
 #include <pscript/context.hpp>
+#include <pscript/module_cache.hpp>
 
 #include <peglib.h>
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <iomanip>
@@ -101,7 +105,7 @@ typename <- (builtin_type / namespace_list? identifier) ampersand? { no_ast_opt
 namespace_list <- (namespace '.')+ { no_ast_opt }
 namespace <- identifier
 # match builtin types separately for easier interpreting
-builtin_type <- 'uint' / 'int' / 'float' / 'str' / 'list' / 'any'
+builtin_type <- 'uint' / 'int' / 'float' / 'bool' / 'str' / 'list' / 'any'
 
 # ================= namespaces =================
 
@@ -247,11 +251,89 @@ comment <- '//' any '\n'
 
 using namespace std::literals::string_literals;
 
-context::context(std::size_t mem_size) : mem(mem_size) {
-    ast_parser = std::make_unique<peg::parser>(grammar);
-    if (ast_parser == nullptr) throw std::runtime_error("failed to create parser");
-    ast_parser->enable_ast();
-    ast_parser->enable_packrat_parsing();
+namespace {
+
+struct shared_grammar {
+    std::unique_ptr<peg::parser> parser = nullptr;
+    // amount of rules in the grammar, peglib's memo tables have an entry for every rule at every position.
+    std::size_t rules = 0;
+};
+
+shared_grammar create_parser(bool packrat) {
+    shared_grammar result { std::make_unique<peg::parser>(grammar) };
+    if (!*result.parser) throw std::runtime_error("failed to create parser");
+    result.parser->enable_ast<peg::Ast>();
+    if (packrat) result.parser->enable_packrat_parsing();
+    result.rules = result.parser->get_grammar().size();
+    return result;
+}
+
+// Compiled parsers that no thread is using. peglib changes the state of the grammar while parsing, so a parser cannot be used by
+// multiple threads at once, and every thread takes one for itself. It gives it back when it exits, so the next thread reuses it
+// instead of compiling the grammar again. A parser is only compiled when all of them are taken by running threads.
+class grammar_pool {
+public:
+    shared_grammar acquire(bool packrat) {
+        {
+            std::lock_guard lock { mutex };
+            auto& parsers = available[packrat];
+            if (!parsers.empty()) {
+                shared_grammar result = std::move(parsers.back());
+                parsers.pop_back();
+                return result;
+            }
+        }
+        return create_parser(packrat);
+    }
+
+    void release(bool packrat, shared_grammar parser) {
+        std::lock_guard lock { mutex };
+        available[packrat].push_back(std::move(parser));
+    }
+
+private:
+    std::mutex mutex {};
+    // indexed by whether packrat parsing is enabled
+    std::array<std::vector<shared_grammar>, 2> available {};
+};
+
+grammar_pool& grammars() {
+    static grammar_pool pool {};
+    return pool;
+}
+
+// Parser taken by a thread, given back to the pool when the thread exits.
+struct thread_grammar {
+    explicit thread_grammar(bool packrat) : packrat(packrat), grammar(grammars().acquire(packrat)) {}
+
+    ~thread_grammar() {
+        grammars().release(packrat, std::move(grammar));
+    }
+
+    thread_grammar(thread_grammar const&) = delete;
+    thread_grammar& operator=(thread_grammar const&) = delete;
+
+    bool packrat = false;
+    shared_grammar grammar {};
+};
+
+}
+
+// The parser is shared by all contexts on a thread. Packrat parsing is a setting of the whole parser, so a thread has one parser
+// with and one without it, each taken on first use.
+static shared_grammar const& shared_parser(bool packrat) {
+    if (packrat) {
+        static thread_local thread_grammar const with_packrat { true };
+        return with_packrat.grammar;
+    }
+    static thread_local thread_grammar const without_packrat { false };
+    return without_packrat.grammar;
+}
+
+context::context(std::size_t mem_size, ps::parser_backend backend, ps::packrat_mode packrat)
+    : mem(mem_size), parser_type(backend), packrat_type(packrat) {
+    // make sure the grammar is compiled when the context is created, and not while parsing its first script.
+    [[maybe_unused]] peg::parser const& _ = parser(packrat != ps::packrat_mode::off);
 }
 
 ps::memory_pool& context::memory() noexcept {
@@ -296,35 +378,68 @@ ps::memory_pool const& context::memory() const noexcept {
     out.fill(old_fill);
 }
 
-peg::parser const& context::parser() const noexcept {
-    return *ast_parser;
+peg::parser const& context::parser(bool packrat) const noexcept {
+    return *shared_parser(packrat).parser;
+}
+
+std::size_t context::grammar_rules() noexcept {
+    return shared_parser(true).rules;
+}
+
+bool context::use_packrat(std::size_t source_size) const noexcept {
+    switch (packrat_type) {
+        case ps::packrat_mode::off:
+            return false;
+        case ps::packrat_mode::on:
+            return true;
+        case ps::packrat_mode::adaptive:
+            return source_size <= ps::adaptive_packrat_limit;
+    }
+    return true;
+}
+
+ps::parser_backend context::backend() const noexcept {
+    return parser_type;
+}
+
+ps::packrat_mode context::packrat() const noexcept {
+    return packrat_type;
 }
 
 ps::variable& context::create_variable(std::string const& name, ps::value&& initializer, block_scope* scope) {
+    return create_variable(ps::intern(name), std::move(initializer), scope);
+}
+
+ps::variable& context::create_variable(ps::symbol name, ps::value&& initializer, block_scope* scope) {
     auto& variables = scope ? scope->local_variables : global_variables;
     if (auto old = variables.find(name); old != variables.end()) {
         // Variable already exists, so shadow it with a new type by assigning a new value to it.
         // We first need to free the old memory
-        old->second.value() = std::move(initializer);
-        return old->second;
-    } else {
-        auto it = variables.insert({name, ps::variable(name, std::move(initializer))});
-        // make sure name string view points to the entry in the map, so it is guaranteed to live as long as the variable lives.
-        it.first->second.set_name(it.first->first);
-        return it.first->second;
+        if (!old->second.value().is_host()) {
+            old->second.value() = std::move(initializer);
+            return old->second;
+        }
+        // assigning would write to host memory, so replace the variable instead
+        variables.erase(old);
     }
+    // the symbol table keeps names alive for the entire program, so the name string view can never dangle.
+    auto it = variables.insert({name, ps::variable(symbol_name(name), std::move(initializer))});
+    return it.first->second;
 }
 
+ps::variable& context::get_variable(std::string const& name, ps::ast_node const* node, block_scope* scope) {
+    return get_variable(ps::intern(name), node, scope);
+}
 
-ps::variable& context::get_variable(std::string const& name, ps::Ast const* node, block_scope* scope) {
+ps::variable& context::get_variable(ps::symbol name, ps::ast_node const* node, block_scope* scope) {
     ps::variable* var = find_variable(name, scope);
-    if (!var) report_error(node, fmt::format("Variable '{}' not declared in current scope.", name));
+    if (!var) report_error(node, fmt::format("Variable '{}' not declared in current scope.", symbol_name(name)));
     else return *var;
 
     PLIB_UNREACHABLE();
 }
 
-[[nodiscard]] ps::variable* context::find_variable(std::string const& name, block_scope* scope) {
+[[nodiscard]] ps::variable* context::find_variable(ps::symbol name, block_scope* scope) {
     auto& variables = scope ? scope->local_variables : global_variables;
     auto it = variables.find(name);
     if (it == variables.end()) {
@@ -338,7 +453,7 @@ ps::variable& context::get_variable(std::string const& name, ps::Ast const* node
     else return &it->second;
 }
 
-void context::delete_variable(std::string const& name, block_scope* scope) {
+void context::delete_variable(ps::symbol name, block_scope* scope) {
     auto& variables = scope ? scope->local_variables : global_variables;
     auto it = variables.find(name);
     if (it == variables.end()) {
@@ -351,17 +466,26 @@ void context::delete_variable(std::string const& name, block_scope* scope) {
     variables.erase(it);
 }
 
-ps::value& context::get_variable_value(std::string const& name, ps::Ast const* node, block_scope* scope) {
+ps::value& context::get_variable_value(std::string const& name, ps::ast_node const* node, block_scope* scope) {
+    return get_variable(name, node, scope).value();
+}
+
+ps::value& context::get_variable_value(ps::symbol name, ps::ast_node const* node, block_scope* scope) {
     return get_variable(name, node, scope).value();
 }
 
 
 void context::execute(ps::script const& script, ps::execution_context exec) {
     try {
-        std::shared_ptr<ps::Ast> const& ast = script.ast();
+        ps::ast_node const* ast = script.ast();
         if (!ast) throw std::runtime_error("Invalid syntax");
         exec_ctx = std::move(exec);
-        execute(ast.get(), nullptr); // start execution in global scope
+        check_externs();
+        // parse all modules this script needs up front, in parallel
+        if (!script.imports().empty()) {
+            ps::module_cache::global().preload(script, exec_ctx.module_paths, *this);
+        }
+        execute(ast, nullptr); // start execution in global scope
     } catch(std::exception const& e) {
         if (exec_ctx.err) {
             *exec_ctx.err << "execution terminated due to unexpected exception: " << e.what() << std::endl;
@@ -369,12 +493,147 @@ void context::execute(ps::script const& script, ps::execution_context exec) {
     }
 }
 
+// Pops the call when it returns or unwinds. Scripts whose functions were redefined during a call are released once the
+// outermost call is gone, on both paths.
+struct context::call_frame {
+    call_frame(context& ctx, function_call call) : ctx(ctx) {
+        ctx.call_stack.push(std::move(call));
+    }
+
+    ~call_frame() {
+        ctx.call_stack.pop();
+        if (ctx.call_stack.empty()) ctx.retired_scripts.clear();
+    }
+
+    call_frame(call_frame const&) = delete;
+    call_frame& operator=(call_frame const&) = delete;
+
+    context& ctx;
+};
+
+namespace {
+
+// Makes a script the owner of functions defined while it executes, and restores the previous owner afterwards.
+struct owner_scope {
+    owner_scope(std::shared_ptr<ps::script const>& current, std::shared_ptr<ps::script const> script)
+        : current(current), previous(std::exchange(current, std::move(script))) {}
+
+    ~owner_scope() {
+        current = std::move(previous);
+    }
+
+    std::shared_ptr<ps::script const>& current;
+    std::shared_ptr<ps::script const> previous;
+};
+
+// Compares two definitions, ignoring where they are in the source.
+bool same_definition(ps::ast_node const& lhs, ps::ast_node const& rhs) {
+    if (lhs.tag != rhs.tag || lhs.original_tag != rhs.original_tag) return false;
+    if (lhs.is_token != rhs.is_token || lhs.token != rhs.token) return false;
+    if (lhs.child_count != rhs.child_count) return false;
+    for (std::size_t i = 0; i < lhs.child_count; ++i) {
+        if (!same_definition(lhs.nodes()[i], rhs.nodes()[i])) return false;
+    }
+    return true;
+}
+
+}
+
 void context::execute(std::shared_ptr<ps::script> const& script, ps::execution_context exec) {
-    execute(*script, exec);
-    executed_scripts.push_back(script);
+    owner_scope owner { current_script, script };
+    execute(*script, std::move(exec));
+}
+
+// Deep copies all global variables into an empty map. Lists and structs are copied once, even if several globals or elements
+// share them, and a global that is a reference to another global refers to the copy of that global, so all aliasing is kept.
+static void clone_globals(std::unordered_map<ps::symbol, ps::variable> const& from, std::unordered_map<ps::symbol, ps::variable>& to) {
+    ps::clone_map copies {};
+    // copies of globals that store a number, references to them refer to the copy instead of copying the number.
+    std::unordered_map<ps::pointer, ps::value const*> numbers {};
+    auto clone = [&](ps::symbol name, ps::variable const& var) {
+        ps::value const& original = var.value();
+        auto number = numbers.find(original.pointer());
+        if (original.is_reference() && number != numbers.end()) {
+            to.insert({name, ps::variable(var.name(), ps::value::ref(*number->second))});
+            return;
+        }
+        auto it = to.insert({name, ps::variable(var.name(), original.clone(copies))}).first;
+        ps::type const type = original.get_type();
+        if (!original.is_reference() && type != ps::type::list && type != ps::type::structure && original.pointer() != ps::null_pointer) {
+            numbers[original.pointer()] = &it->second.value();
+        }
+    };
+    // values are copied before the references to them
+    for (auto const& [name, var] : from) {
+        if (!var.value().is_reference()) clone(name, var);
+    }
+    for (auto const& [name, var] : from) {
+        if (var.value().is_reference()) clone(name, var);
+    }
 }
 
-ps::value context::execute(ps::Ast const* node, block_scope* scope, std::string const& namespace_prefix) {
+std::uint64_t extern_library::next_version() noexcept {
+    static std::atomic<std::uint64_t> version = 0;
+    return ++version;
+}
+
+void context::check_externs() {
+    bool changed = false;
+    std::size_t count = 0;
+    for (extern_library const* lib = exec_ctx.externs; lib != nullptr; lib = lib->next.get(), ++count) {
+        if (count == externs_versions.size()) {
+            externs_versions.push_back(lib->version());
+            changed = true;
+        } else if (externs_versions[count] != lib->version()) {
+            externs_versions[count] = lib->version();
+            changed = true;
+        }
+    }
+    if (count != externs_versions.size()) {
+        externs_versions.resize(count);
+        changed = true;
+    }
+    if (changed) ++externs_generation;
+}
+
+context::checkpoint context::snapshot() const {
+    checkpoint saved {};
+    clone_globals(global_variables, saved.global_variables);
+    saved.functions = functions;
+    saved.structs = structs;
+    saved.imported_scripts = imported_scripts;
+    return saved;
+}
+
+void context::restore(checkpoint const& saved) {
+    global_variables.clear();
+    // clone again, so the checkpoint itself is never modified and can be restored again later.
+    clone_globals(saved.global_variables, global_variables);
+    functions = saved.functions;
+    ++functions_generation;
+    structs = saved.structs;
+    imported_scripts = saved.imported_scripts;
+}
+
+void context::reset() {
+    // clear() keeps the bucket arrays, so refilling the maps after a reset does not allocate them again.
+    global_variables.clear();
+    functions.clear();
+    ++functions_generation;
+    structs.clear();
+    imported_scripts.clear();
+    call_stack = {};
+    retired_scripts.clear();
+}
+
+ps::function_handle context::find_function(std::string const& name) {
+    ps::symbol const sym = ps::intern(name);
+    auto it = functions.find(sym);
+    if (it == functions.end()) return {};
+    return ps::function_handle { this, sym, &it->second, functions_generation };
+}
+
+ps::value context::execute(ps::ast_node const* node, block_scope* scope, std::string const& namespace_prefix) {
     if (node_is_type(node, "declaration"_)) {
         evaluate_declaration(node, scope);
     }
@@ -413,8 +672,8 @@ ps::value context::execute(ps::Ast const* node, block_scope* scope, std::string
     }
 
     if (node_is_type(node, "statement"_) || node_is_type(node, "compound"_) || node_is_type(node, "script"_) || node_is_type(node, "content"_)) {
-        for (auto const& child : node->nodes) {
-            execute(child.get(), scope, namespace_prefix);
+        for (auto const& child : node->nodes()) {
+            execute(&child, scope, namespace_prefix);
 
             if (has_returned()) return *call_stack.top().return_val;
         }
@@ -423,19 +682,20 @@ ps::value context::execute(ps::Ast const* node, block_scope* scope, std::string
     if (node_is_type(node, "return"_)) {
         call_stack.top().return_val = ps::value::null();
         // first child node of a return statement is the return expression.
-        if (!node->nodes.empty()) {
+        if (!node->nodes().empty()) {
             auto& call = call_stack.top();
-            ps::value return_value = evaluate_expression(node->nodes[0].get(), scope);
+            ps::value return_value = evaluate_expression(&node->nodes()[0], scope);
             if (!try_cast(return_value, return_value.get_type(), call.func->return_type)) {
-                report_error(node, fmt::format("In function {}: cannot cast return value from '{}' to '{}'.", call.func->name,
+                report_error(node, fmt::format("In function {}: cannot cast return value from '{}' to '{}'.", symbol_name(call.func->name),
                                                type_str(return_value.get_type()),
                                                type_str(call.func->return_type)));
             }
 
             if (call.func->return_type == ps::type::structure) {
-                auto const& name = static_cast<ps::structure const&>(return_value)->type_name();
+                auto const name = static_cast<ps::structure const&>(return_value)->type_symbol();
                 if (name != call.func->return_type_name) {
-                    report_error(node, fmt::format("In function {}: cannot cast return value from '{}' to '{}'.", call.func->name, name, call.func->return_type_name));
+                    report_error(node, fmt::format("In function {}: cannot cast return value from '{}' to '{}'.", symbol_name(call.func->name),
+                                                   symbol_name(name), symbol_name(call.func->return_type_name)));
                 }
             }
 
@@ -444,17 +704,17 @@ ps::value context::execute(ps::Ast const* node, block_scope* scope, std::string
     }
 
     if (node_is_type(node, "if"_)) {
-        ps::Ast const* condition_node = find_child_with_type(node, "expression"_);
+        ps::ast_node const* condition_node = find_child_with_type(node, "expression"_);
         ps::value condition = evaluate_expression(condition_node, scope);
         // If the condition evaluates to true, we can execute the compound block with a new scope
         block_scope local_scope {};
         local_scope.parent = scope;
         if (static_cast<bool>(condition)) {
-            ps::Ast const* compound = find_child_with_type(node, "compound"_);
+            ps::ast_node const* compound = find_child_with_type(node, "compound"_);
             execute(compound, &local_scope);
         } else {
             // if an else block is present, execute it
-            ps::Ast const* else_block = find_child_with_type(node, "else"_);
+            ps::ast_node const* else_block = find_child_with_type(node, "else"_);
             if (else_block) {
                 execute(find_child_with_type(else_block, "compound"_), &local_scope);
             }
@@ -462,8 +722,8 @@ ps::value context::execute(ps::Ast const* node, block_scope* scope, std::string
     }
 
     if (node_is_type(node, "while"_)) {
-        ps::Ast const* condition_node = find_child_with_type(node, "expression"_);
-        ps::Ast const* compound = find_child_with_type(node, "compound"_);
+        ps::ast_node const* condition_node = find_child_with_type(node, "expression"_);
+        ps::ast_node const* compound = find_child_with_type(node, "compound"_);
         while(static_cast<bool>(evaluate_expression(condition_node, scope))) {
             block_scope local_scope {};
             local_scope.parent = scope;
@@ -472,19 +732,19 @@ ps::value context::execute(ps::Ast const* node, block_scope* scope, std::string
     }
 
     if (node_is_type(node, "for"_)) {
-        ps::Ast const* content = find_child_with_type(node, "for_content"_);
-        ps::Ast const* compound = find_child_with_type(node, "compound"_);
+        ps::ast_node const* content = find_child_with_type(node, "for_content"_);
+        ps::ast_node const* compound = find_child_with_type(node, "compound"_);
         if (node_is_type(content, "for_each"_)) {
-            ps::Ast const* identifier = find_child_with_type(content, "identifier"_);
-            ps::Ast const* iterable = find_child_with_type(content, "expression"_);
-            ps::Ast const* range = find_child_with_type(content, "range_expression"_);
+            ps::ast_node const* identifier = find_child_with_type(content, "identifier"_);
+            ps::ast_node const* iterable = find_child_with_type(content, "expression"_);
+            ps::ast_node const* range = find_child_with_type(content, "range_expression"_);
             // using for (let i : N..M) syntax
             if (range) {
-                ps::Ast const* begin = range->nodes[0].get();
-                ps::Ast const* end = range->nodes[1].get();
+                ps::ast_node const* begin = &range->nodes()[0];
+                ps::ast_node const* end = &range->nodes()[1];
                 block_scope iterator_scope {};
                 iterator_scope.parent = scope;
-                ps::variable& iterator = create_variable(identifier->token_to_string(), evaluate_expression(begin, scope), &iterator_scope);
+                ps::variable& iterator = create_variable(identifier->sym, evaluate_expression(begin, scope), &iterator_scope);
                 ps::value& it = iterator.value();
                 ps::value end_val = evaluate_expression(end, &iterator_scope);
                 while(it < end_val) {
@@ -508,18 +768,18 @@ ps::value context::execute(ps::Ast const* node, block_scope* scope, std::string
                 for (std::size_t i = 0; i < list->size(); ++i) {
                     block_scope local_scope {};
                     local_scope.parent = scope;
-                    ps::variable& it = create_variable(identifier->token_to_string(), ps::value::ref(list->get(i)), &local_scope);
+                    ps::variable& it = create_variable(identifier->sym, ps::value::ref(list->get(i)), &local_scope);
                     execute(compound, &local_scope, namespace_prefix);
                 }
             }
         } else { // regular for loop
-            ps::Ast const* initializer = find_child_with_type(content, "declaration"_);
-            ps::Ast const* condition = find_child_with_type(content, "expression"_);
-            ps::Ast const* on_iterate = nullptr;
-            for (auto const& child : content->nodes) {
-                if (child.get() == condition) continue;
-                if (node_is_type(child.get(), "expression"_) || node_is_type(child.get(), "statement"_))  {
-                    on_iterate = child.get();
+            ps::ast_node const* initializer = find_child_with_type(content, "declaration"_);
+            ps::ast_node const* condition = find_child_with_type(content, "expression"_);
+            ps::ast_node const* on_iterate = nullptr;
+            for (auto const& child : content->nodes()) {
+                if (&child == condition) continue;
+                if (node_is_type(&child, "expression"_) || node_is_type(&child, "statement"_))  {
+                    on_iterate = &child;
                     break;
                 }
             }
@@ -536,29 +796,28 @@ ps::value context::execute(ps::Ast const* node, block_scope* scope, std::string
     }
 
     if (node_is_type(node, "delete"_)) {
-        ps::Ast const* identifier = find_child_with_type(node, "identifier"_);
-        std::string var = identifier->token_to_string();
-        delete_variable(var, scope);
+        ps::ast_node const* identifier = find_child_with_type(node, "identifier"_);
+        delete_variable(identifier->sym, scope);
     }
 
     if (has_returned()) return *call_stack.top().return_val;
     else return ps::value::null();
 }
 
-ps::Ast const* context::find_child_with_type(ps::Ast const* node, unsigned int type) noexcept {
-    for (auto const& child : node->nodes) {
-        if (node_is_type(child.get(), type)) return child.get();
+ps::ast_node const* context::find_child_with_type(ps::ast_node const* node, unsigned int type) noexcept {
+    for (auto const& child : node->nodes()) {
+        if (node_is_type(&child, type)) return &child;
     }
     return nullptr;
 }
 
-bool context::node_is_type(ps::Ast const* node, unsigned int type) noexcept {
+bool context::node_is_type(ps::ast_node const* node, unsigned int type) noexcept {
     return node->tag == type || node->original_tag == type;
 }
 
-void context::evaluate_declaration(ps::Ast const* node, block_scope* scope) {
-    ps::Ast const* identifier = find_child_with_type(node, "identifier"_);
-    ps::Ast const* initializer = find_child_with_type(node, "expression"_);
+void context::evaluate_declaration(ps::ast_node const* node, block_scope* scope) {
+    ps::ast_node const* identifier = find_child_with_type(node, "identifier"_);
+    ps::ast_node const* initializer = find_child_with_type(node, "expression"_);
 
     if (!identifier) {
         report_error(node, "Expected an identifier in declaration.");
@@ -571,91 +830,113 @@ void context::evaluate_declaration(ps::Ast const* node, block_scope* scope) {
 
     ps::value init_val = evaluate_expression(initializer, scope);
 
-    ps::variable& var = create_variable(identifier->token_to_string(), std::move(init_val), scope);
+    ps::variable& var = create_variable(identifier->sym, std::move(init_val), scope);
+}
+
+void context::evaluate_function_definition(ps::ast_node const* node, std::string const& namespace_prefix) {
+    ps::ast_node const* identifier = find_child_with_type(node, "identifier"_);
+    ps::symbol const name = namespace_prefix.empty() ? identifier->sym : ps::intern(namespace_prefix + symbol_name(identifier->sym));
+
+    auto existing = functions.find(name);
+    // Defining the same function again (for example in interactive mode) keeps the existing one, so the script with the new
+    // definition can be released. Definitions without an owner may already be destroyed, so those are always replaced.
+    if (existing != functions.end() && existing->second.owner && same_definition(*existing->second.definition, *node)) {
+        return;
+    }
+
+    // Only remember the definition here, it is analyzed when the function is called for the first time.
+    // Modules define many functions while a script usually calls only a few of them.
+    function func {};
+    func.definition = node;
+    func.owner = current_script;
+    func.name = name;
+    if (existing != functions.end()) {
+        // the old definition may still be running
+        if (!call_stack.empty() && existing->second.owner) retired_scripts.push_back(std::move(existing->second.owner));
+        existing->second = std::move(func);
+    } else {
+        functions.insert({name, std::move(func)});
+    }
 }
 
-void context::evaluate_function_definition(ps::Ast const* node, std::string const& namespace_prefix) {
-    ps::Ast const* identifier = find_child_with_type(node, "identifier"_);
-    ps::Ast const* params = find_child_with_type(node, "parameter_list"_);
-    ps::Ast const* ret_type = find_child_with_type(node, "typename"_);
+void context::compile_function(function& func) {
+    ps::ast_node const* node = func.definition;
+    ps::ast_node const* params = find_child_with_type(node, "parameter_list"_);
+    ps::ast_node const* ret_type = find_child_with_type(node, "typename"_);
 
     // If a function is external, this node will be null.
     // We will use this to test for an external function on the call site, and
     // execute the external call if so.
-    ps::Ast const* content = find_child_with_type(node, "compound"_);
-    function func {};
+    ps::ast_node const* content = find_child_with_type(node, "compound"_);
     func.node = content;
     func.return_type = evaluate_type(ret_type);
     if (func.return_type == ps::type::structure) {
         func.return_type_name = evaluate_type_name(ret_type);
     }
     if (params) {
-        for (auto const& child : params->nodes) {
-            if (node_is_type(child.get(), "variadic"_)) {
-                ps::Ast const* param_name = find_child_with_type(child.get(), "identifier"_);
+        for (auto const& child : params->nodes()) {
+            if (node_is_type(&child, "variadic"_)) {
+                ps::ast_node const* param_name = find_child_with_type(&child, "identifier"_);
                 func.params.push_back(function::parameter{
-                    .name = param_name->token_to_string(),
+                    .name = param_name->sym,
                     .type = type::any,
-                    .type_name = "",
+                    .type_name = ps::null_symbol,
                     .is_variadic = true
                 });
                 // variadic is always the last parameter, so this is easy
                 break;
             }
 
-            if (!node_is_type(child.get(), "parameter"_)) continue;
-            ps::Ast const* param_name = find_child_with_type(child.get(), "identifier"_);
-            ps::Ast const* param_type = find_child_with_type(child.get(), "typename"_);
+            if (!node_is_type(&child, "parameter"_)) continue;
+            ps::ast_node const* param_name = find_child_with_type(&child, "identifier"_);
+            ps::ast_node const* param_type = find_child_with_type(&child, "typename"_);
             ps::type const type = evaluate_type(param_type);
-            std::string type_name {};
+            ps::symbol type_name = ps::null_symbol;
             if (type == ps::type::structure) {
                 type_name = evaluate_type_name(param_type);
             }
-            func.params.push_back(function::parameter{ .name = param_name->token_to_string(), .type = type, .type_name = type_name });
+            func.params.push_back(function::parameter{ .name = param_name->sym, .type = type, .type_name = type_name });
         }
     }
-    std::string name = namespace_prefix + identifier->token_to_string();
-    auto it = functions.insert({name, std::move(func)});
-    // set key reference
-    it.first->second.name = it.first->first;
+    func.compiled = true;
 }
 
-void context::evaluate_struct_definition(ps::Ast const* node, std::string const& namespace_prefix) {
-    ps::Ast const* identifier = find_child_with_type(node, "identifier"_);
-    ps::Ast const* members = find_child_with_type(node, "struct_items"_);
+void context::evaluate_struct_definition(ps::ast_node const* node, std::string const& namespace_prefix) {
+    ps::ast_node const* identifier = find_child_with_type(node, "identifier"_);
+    ps::ast_node const* members = find_child_with_type(node, "struct_items"_);
     struct_description info {};
 
     if (members) {
-        for (auto const& field : members->nodes) {
-            if (!node_is_type(field.get(), "struct_item"_)) continue;
+        for (auto const& field : members->nodes()) {
+            if (!node_is_type(&field, "struct_item"_)) continue;
 
-            ps::Ast const* name = find_child_with_type(field.get(), "identifier"_);
-            ps::Ast const* initializer = find_child_with_type(field.get(), "struct_initializer"_);
-            ps::Ast const* field_type = find_child_with_type(field.get(), "typename"_);
-            ps::Ast const* init_expression = find_child_with_type(initializer, "expression"_);
+            ps::ast_node const* name = find_child_with_type(&field, "identifier"_);
+            ps::ast_node const* initializer = find_child_with_type(&field, "struct_initializer"_);
+            ps::ast_node const* field_type = find_child_with_type(&field, "typename"_);
+            ps::ast_node const* init_expression = find_child_with_type(initializer, "expression"_);
             ps::value init_value = evaluate_expression(init_expression, nullptr);
             ps::type const type = evaluate_type(field_type);
-            std::string type_name {};
+            ps::symbol type_name = ps::null_symbol;
             if (type == ps::type::structure) {
                 type_name = evaluate_type_name(field_type);
             }
             if (!try_cast(init_value, init_value.get_type(), type)) {
-                report_error(field.get(), fmt::format("In struct initializer for member {}: Cannot convert from type '{}' to '{}'.", name->token_to_string(),
+                report_error(&field, fmt::format("In struct initializer for member {}: Cannot convert from type '{}' to '{}'.", name->token_to_string(),
                                                       type_str(init_value.get_type()), type_str(type)));
                 PLIB_UNREACHABLE();
             }
 
             if (type == ps::type::structure) {
-                auto const& other_name = static_cast<ps::structure const&>(init_value)->type_name();
+                auto const other_name = static_cast<ps::structure const&>(init_value)->type_symbol();
                 if (type_name != other_name) {
-                    report_error(field.get(), fmt::format("In struct initializer for member {}: Cannot convert from type '{}' to '{}'.",
-                                                          name->token_to_string(), other_name, type_name));
+                    report_error(&field, fmt::format("In struct initializer for member {}: Cannot convert from type '{}' to '{}'.",
+                                                          name->token_to_string(), symbol_name(other_name), symbol_name(type_name)));
                     PLIB_UNREACHABLE();
                 }
             }
 
             struct_description::member field_info {
-                name->token_to_string(),
+                name->sym,
                 std::move(init_value),
                 type,
                 type_name
@@ -664,13 +945,13 @@ void context::evaluate_struct_definition(ps::Ast const* node, std::string const&
         }
     }
 
-    std::string name = namespace_prefix + identifier->token_to_string();
-    auto it = structs.insert({ name, std::move(info) });
-    it.first->second.name = it.first->first;
+    ps::symbol const name = namespace_prefix.empty() ? identifier->sym : ps::intern(namespace_prefix + symbol_name(identifier->sym));
+    info.name = name;
+    structs.insert({ name, std::move(info) });
 }
 
-ps::type context::evaluate_type(ps::Ast const* node) {
-    ps::Ast const* builtin = find_child_with_type(node, "builtin_type"_);
+ps::type context::evaluate_type(ps::ast_node const* node) {
+    ps::ast_node const* builtin = find_child_with_type(node, "builtin_type"_);
     if (builtin) {
         std::string const& name = builtin->token_to_string();
         if (name == "int") return ps::type::integer;
@@ -686,20 +967,20 @@ ps::type context::evaluate_type(ps::Ast const* node) {
     return ps::type::structure;
 }
 
-std::string context::evaluate_type_name(ps::Ast const* node) {
+ps::symbol context::evaluate_type_name(ps::ast_node const* node) {
     // TODO: namespace support
-    ps::Ast const* identifier = find_child_with_type(node, "identifier"_);
-    return identifier->token_to_string();
+    ps::ast_node const* identifier = find_child_with_type(node, "identifier"_);
+    return identifier->sym;
 }
 
-void context::evaluate_extern_variable(ps::Ast const* node, std::string const& namespace_prefix) {
+void context::evaluate_extern_variable(ps::ast_node const* node, std::string const& namespace_prefix) {
     if (!exec_ctx.externs) {
         report_error(node, "Tried to load external variable, but no extern library was bound.");
         PLIB_UNREACHABLE();
     }
 
-    ps::Ast const* identifier = find_child_with_type(node, "identifier"_);
-    ps::Ast const* type = find_child_with_type(node, "typename"_);
+    ps::ast_node const* identifier = find_child_with_type(node, "identifier"_);
+    ps::ast_node const* type = find_child_with_type(node, "typename"_);
 
     std::string name = namespace_prefix + identifier->token_to_string();
 
@@ -715,71 +996,67 @@ void context::evaluate_extern_variable(ps::Ast const* node, std::string const& n
         PLIB_UNREACHABLE();
     }
     ps::type stored_type = evaluate_type(type);
-    ps::value val = ps::value::from(memory(), ps::external_type { external_ptr, stored_type });
-    auto& _ = create_variable(name, std::move(val));
-}
-
-static std::string read_script(std::ifstream& file) {
-    return std::string { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    // Scalars are used directly in the host's memory, so scripts and the host always see the same value.
+    // Other types can only be passed back to the host.
+    bool const is_scalar = stored_type == ps::type::integer || stored_type == ps::type::uint
+                           || stored_type == ps::type::real || stored_type == ps::type::boolean;
+    ps::value val = is_scalar ? ps::value::host(memory(), external_ptr, stored_type)
+                              : ps::value::from(memory(), ps::external_type { external_ptr, stored_type });
+    auto& _ = create_variable(ps::intern(name), std::move(val));
 }
 
-void context::evaluate_import(ps::Ast const* node) {
-    std::vector<std::string> folders = {};
-    for (auto const& child : node->nodes) {
-        if (node_is_type(child.get(), "module_folder"_)) {
-            folders.push_back(child->token_to_string());
+void context::evaluate_import(ps::ast_node const* node) {
+    // build the module name from its folders and name, for example std.io
+    std::string module_name;
+    for (auto const& child : node->nodes()) {
+        if (node_is_type(&child, "module_folder"_)) {
+            module_name += child.token;
+            module_name += '.';
         }
     }
+    module_name += find_child_with_type(node, "module_name"_)->token;
 
-    ps::Ast const* module_name = find_child_with_type(node, "module_name"_);
-
-    // resolve module folders + name into a module file
-    std::string path;
-    for (auto const& folder : folders) {
-        path += folder + '/';
-    }
-    path += module_name->token_to_string() + ".ps";
-
-    std::string filepath = path;
-    for (auto const& mod_path : exec_ctx.module_paths) {
-        filepath = mod_path + path;
-        std::ifstream in { filepath };
-        if (in.is_open()) break; // found matching path
-    }
-
-    std::ifstream module_file { filepath };
-    if (!module_file.is_open()) {
-        report_error(node, fmt::format("Module '{}' not found.", filepath));
+    std::string const filepath = ps::module_cache::global().resolve(module_name, exec_ctx.module_paths);
+    if (filepath.empty()) {
+        report_error(node, fmt::format("Module '{}' not found.", module_name));
         PLIB_UNREACHABLE();
     }
 
     // import only if not yet imported
-    auto it = std::find_if(imported_scripts.begin(), imported_scripts.end(), [&filepath](import_data const& i) -> bool {
-        return i.filepath == filepath;
-    });
-
-    if (it != imported_scripts.end()) {
+    if (imported_scripts.contains(filepath)) {
         return;
     }
 
-    // import it
-    imported_scripts.push_back(import_data{ filepath, ps::script { read_script(module_file), *this } });
-    ps::Ast const* ast = imported_scripts.back().script.ast().get();
-
-    // build namespace string
-    std::string namespace_prefix;
-    for (auto const& folder : folders) {
-        namespace_prefix += folder + '.';
+    // import it, modules are parsed only once and shared between all contexts
+    std::shared_ptr<ps::script const> script = ps::module_cache::global().load(filepath, *this);
+    if (!script) {
+        report_error(node, fmt::format("Module '{}' not found.", module_name));
+        PLIB_UNREACHABLE();
     }
-    namespace_prefix += module_name->token_to_string() + '.';
+    ps::ast_node const* ast = script->ast();
+    imported_scripts.insert({ filepath, script });
+
     // run imported scripts in a local scope to make sure variables dont collide.
     block_scope local_scope {};
-    execute(ast, &local_scope, namespace_prefix);
+    owner_scope owner { current_script, std::move(script) };
+    execute(ast, &local_scope, module_name + '.');
 }
 
-ps::value context::evaluate_operand(ps::Ast const* node, block_scope* scope, bool ref) {
+ps::value context::evaluate_operand(ps::ast_node const* node, block_scope* scope, bool ref) {
     assert(node_is_type(node, "operand"_));
 
+    // identifiers were resolved to a symbol when loading the script
+    if (node->sym != ps::null_symbol) {
+        if (ref) {
+            return ps::value::ref(get_variable_value(node->sym, node, scope));
+        } else return get_variable_value(node->sym, node, scope);
+    }
+
+    // string literal, this shares the literal data stored in the AST instead of copying it.
+    if (node->literal) {
+        return ps::value::from(memory(), ps::str::value_type { *node->literal });
+    }
+
     std::string str_repr = node->token_to_string();
 
     if (str_repr == "true") return ps::value::from(memory(), true);
@@ -801,23 +1078,11 @@ ps::value context::evaluate_operand(ps::Ast const* node, block_scope* scope, boo
         }
     }
 
-    // string literal
-    if (str_repr[0] == '\"') {
-        if (str_repr.size() > 2) {
-            return ps::value::from(memory(), ps::str::value_type { str_repr.substr(1, str_repr.length() - 2) });
-        } else {
-            // empty string
-            return ps::value::from(memory(), ps::str::value_type {});
-        }
-    }
-
-    // identifier
-    if (ref) {
-        return ps::value::ref(get_variable_value(str_repr, node, scope));
-    } else return get_variable_value(str_repr, node, scope);
+    report_error(node, fmt::format("Invalid operand '{}'.", str_repr));
+    PLIB_UNREACHABLE();
 }
 
-ps::value context::evaluate_operator(ps::Ast const* lhs, ps::Ast const* op, ps::Ast const* rhs, block_scope* scope) {
+ps::value context::evaluate_operator(ps::ast_node const* lhs, ps::ast_node const* op, ps::ast_node const* rhs, block_scope* scope) {
     ps::value left = evaluate_expression(lhs, scope);
     ps::value right = evaluate_expression(rhs, scope);
 
@@ -851,8 +1116,7 @@ ps::value context::evaluate_operator(ps::Ast const* lhs, ps::Ast const* op, ps::
     } else if (node_is_type(lhs, "access_expression"_)) {
         value = &access_member(lhs, scope);
     } else {
-        std::string tok = lhs->token_to_string();
-        ps::variable& var = get_variable(tok, lhs, scope);
+        ps::variable& var = get_variable(lhs->sym, lhs, scope);
         value = &var.value();
     }
     if (op_str == "=") return *value = right;
@@ -869,45 +1133,40 @@ ps::value context::evaluate_operator(ps::Ast const* lhs, ps::Ast const* op, ps::
     PLIB_UNREACHABLE();
 }
 
-std::vector<ps::value> context::evaluate_argument_list(ps::Ast const* call_node, block_scope* scope, bool ref) {
-    ps::Ast const* list = find_child_with_type(call_node, "argument_list"_);
-    if (!list) return {};
+std::vector<ps::value> context::evaluate_argument_list(ps::ast_node const* call_node, block_scope* scope, bool ref) {
     std::vector<ps::value> values {};
-    values.reserve(list->nodes.size());
-    for (auto const& child : list->nodes) {
-        if (node_is_type(child.get(), "argument"_)) {
-            if (node_is_type(child.get(), "variadic_expansion"_)) {
+    evaluate_argument_list(call_node, scope, values, ref);
+    return values;
+}
+
+void context::evaluate_argument_list(ps::ast_node const* call_node, block_scope* scope, std::vector<ps::value>& values, bool ref) {
+    ps::ast_node const* list = find_child_with_type(call_node, "argument_list"_);
+    if (!list) return;
+    for (auto const& child : list->nodes()) {
+        if (node_is_type(&child, "argument"_)) {
+            if (node_is_type(&child, "variadic_expansion"_)) {
                 // if node is a variadic expansion, we need to loop over the elements in the list and expand them by adding them all to our argument list
-                ps::Ast const* identifier = find_child_with_type(child.get(), "identifier"_);
-                auto& list_val = get_variable_value(identifier->token_to_string(), child.get(), scope);
+                ps::ast_node const* identifier = find_child_with_type(&child, "identifier"_);
+                auto& list_val = get_variable_value(identifier->sym, &child, scope);
                 auto& variadic_list = static_cast<ps::list&>(list_val);
                 for (std::size_t i = 0; i < variadic_list->size(); ++i) {
                     values.push_back(variadic_list->get(i));
                 }
             } else {
-                values.push_back(evaluate_expression(child.get(), scope, ref));
+                values.push_back(evaluate_expression(&child, scope, ref));
             }
         }
     }
-    return values;
 }
 
-std::string context::parse_namespace(ps::Ast const* node) {
-    std::string result;
-    for (auto const& child : node->nodes) {
-        if (node_is_type(child.get(), "namespace"_)) {
-            result += ('.' + child->token_to_string());
-        }
-    }
-    // remove first dot
-    result.erase(0, 1);
-    return result;
+void context::prepare_function_scope(ps::ast_node const* call_node, block_scope* call_scope, function* func, block_scope* func_scope) {
+    auto arguments = evaluate_argument_list(call_node, call_scope);
+    prepare_function_scope(call_node, func, arguments, func_scope);
 }
 
-void context::prepare_function_scope(ps::Ast const* call_node, block_scope* call_scope, function* func, block_scope* func_scope) {
+void context::prepare_function_scope(ps::ast_node const* call_node, function* func, std::span<ps::value> arguments, block_scope* func_scope) {
     func_scope->parent = nullptr; // parent is global scope for function calls (as you can't access variables from previous scope, unlike in if statements).
 
-    auto arguments = evaluate_argument_list(call_node, call_scope);
     // no work
     if (func->params.empty()) return;
 
@@ -918,14 +1177,14 @@ void context::prepare_function_scope(ps::Ast const* call_node, block_scope* call
     }
 
     if (arguments.size() < func->params.size()) {
-        report_error(call_node, fmt::format("In call to function {}: expected {} arguments, got {}", func->name, func->params.size(), arguments.size()));
+        report_error(call_node, fmt::format("In call to function {}: expected {} arguments, got {}", symbol_name(func->name), func->params.size(), arguments.size()));
         PLIB_UNREACHABLE();
     }
 
     // create variables with function arguments in call scope and execute type check for each of them
     for (std::size_t i = 0; i < arguments.size(); ++i) {
         if (i >= func->params.size()) {
-            report_error(call_node, fmt::format("In call to function {}: expected {} arguments, got {}", func->name, func->params.size(), arguments.size()));
+            report_error(call_node, fmt::format("In call to function {}: expected {} arguments, got {}", symbol_name(func->name), func->params.size(), arguments.size()));
             PLIB_UNREACHABLE();
         }
 
@@ -947,16 +1206,16 @@ void context::prepare_function_scope(ps::Ast const* call_node, block_scope* call
         ps::type const given_type = arguments[i].get_type();
         ps::type const expected_type = func->params[i].type;
         if (!try_cast(arguments[i], given_type, expected_type)) {
-            report_error(call_node, fmt::format("In call to function {}: Cannot cast argument {} from type '{}' to '{}'.", func->name, i,
+            report_error(call_node, fmt::format("In call to function {}: Cannot cast argument {} from type '{}' to '{}'.", symbol_name(func->name), i,
                                                 type_str(given_type), type_str(expected_type)));
             PLIB_UNREACHABLE();
         }
         // additional type check
         if (expected_type == ps::type::structure) {
-            auto const& name = static_cast<ps::structure const&>(arguments[i])->type_name();
+            auto const name = static_cast<ps::structure const&>(arguments[i])->type_symbol();
             if (name != func->params[i].type_name) {
                 report_error(call_node, fmt::format("In call to function {}: Cannot cast argument {} from type '{}' to '{}'.",
-                                                    func->name, i, name, func->params[i].type_name));
+                                                    symbol_name(func->name), i, symbol_name(name), symbol_name(func->params[i].type_name)));
                 PLIB_UNREACHABLE();
             }
         }
@@ -964,129 +1223,229 @@ void context::prepare_function_scope(ps::Ast const* call_node, block_scope* call
     }
 }
 
-ps::value context::evaluate_function_call(ps::Ast const* node, block_scope* scope) {
-    ps::Ast const* builtin_identifier = find_child_with_type(node, "builtin_function"_);
-    if (builtin_identifier) return evaluate_builtin_function(builtin_identifier->token_to_string(), node, scope);
+ps::value context::evaluate_function_call(ps::ast_node const* node, block_scope* scope) {
+    ps::ast_node const* builtin_identifier = find_child_with_type(node, "builtin_function"_);
+    if (builtin_identifier) return evaluate_builtin_function(builtin_identifier->sym, node, scope);
 
-    ps::Ast const* namespace_identifier = find_child_with_type(node, "namespace_list"_);
-    ps::Ast const* func_identifier_node = find_child_with_type(node, "identifier"_);
+    ps::ast_node const* namespace_identifier = find_child_with_type(node, "namespace_list"_);
 
-    // namespaced functions are simply stored by concatenating their names together to make the full name, but we won't implement that yet
-    std::string func_name = func_identifier_node->token_to_string();
-
-    std::string namespace_name;
     if (namespace_identifier) {
-        namespace_name = parse_namespace(namespace_identifier);
-    }
-
-    if (!namespace_name.empty()) {
         // check if namespace name is a variable, if so we are calling a builtin member function (for list objects for example).
-        ps::variable* var = find_variable(namespace_name, scope);
+        ps::variable* var = find_variable(namespace_identifier->sym, scope);
 
         if (var) {
+            ps::ast_node const* func_identifier_node = find_child_with_type(node, "identifier"_);
             ps::type const type = var->value().get_type();
             if (type == ps::type::list) {
-                return evaluate_list_member_function(func_name, *var, node, scope);
+                return evaluate_list_member_function(func_identifier_node->sym, *var, node, scope);
             } else if (type == ps::type::str) {
-                return evaluate_string_member_function(func_name, *var, node, scope);
+                return evaluate_string_member_function(func_identifier_node->sym, *var, node, scope);
             }
-        } else { // this is a regular function call, still make sure to set lookup name properly
-            func_name = namespace_name + '.' + func_name;
         }
     }
 
+    // namespaced functions are stored by their fully qualified name, which was resolved when loading the script.
+    ps::symbol const func_name = node->sym;
     auto it = functions.find(func_name);
     if (it == functions.end()) {
-        report_error(node, fmt::format("Function '{}' is not defined", func_name));
+        report_error(node, fmt::format("Function '{}' is not defined", symbol_name(func_name)));
         PLIB_UNREACHABLE();
     }
 
+    if (!it->second.compiled) compile_function(it->second);
+
     // If the 'node' field in our function is null, this is an external function call.
     if (it->second.node == nullptr) {
-        return evaluate_external_call(node, scope, func_name);
+        return evaluate_external_call(node, scope, it->second);
     }
 
     // create function scope for this call
     block_scope local_scope {};
 
     prepare_function_scope(node, scope, &it->second, &local_scope);
-    call_stack.push(function_call {.func = &it->second, .scope = &local_scope });
-    ps::value val = execute(it->second.node, &local_scope);
-    call_stack.pop();
-    return val;
+    call_frame frame { *this, function_call {.func = &it->second, .scope = &local_scope } };
+    return execute(it->second.node, &local_scope);
 }
 
-ps::value context::evaluate_external_call(ps::Ast const* node, block_scope* scope, std::string const& name) {
+ps::value context::evaluate_external_call(ps::ast_node const* node, block_scope* scope, function& external) {
+    // Arguments are evaluated into the buffer of this nesting level, which only allocates while it grows. Evaluating an
+    // argument or running the external function can make another external call, which uses the next level.
+    if (extern_depth == extern_arguments.size()) extern_arguments.emplace_back();
+    std::vector<ps::value>& arguments = extern_arguments[extern_depth++];
+    try {
+        evaluate_argument_list(node, scope, arguments);
+        ps::value result = call_external(node, external, arguments);
+        arguments.clear();
+        --extern_depth;
+        return result;
+    } catch (...) {
+        arguments.clear();
+        --extern_depth;
+        throw;
+    }
+}
+
+ps::value context::call_external(ps::ast_node const* node, function& external, std::span<ps::value const> arguments) {
     if (!exec_ctx.externs) {
-        report_error(node, fmt::format("No function library bound, cannot evaluate external call to '{}'.", name));
+        report_error(node, fmt::format("No function library bound, cannot evaluate external call to '{}'.", symbol_name(external.name)));
         PLIB_UNREACHABLE();
     }
 
-    plib::erased_function<ps::value>* func = nullptr;
-    extern_library* cur = exec_ctx.externs;
-    while(func == nullptr && cur != nullptr) {
-        func = cur->get_function(name);
-        cur = cur->next.get();
+    // Look up the function only once for every extern library, instead of searching the library chain on every call.
+    if (external.externs_generation != externs_generation) {
+        ps::extern_function const* found = nullptr;
+        extern_library* cur = exec_ctx.externs;
+        while(found == nullptr && cur != nullptr) {
+            found = cur->get_function(symbol_name(external.name));
+            cur = cur->next.get();
+        }
+
+        if (!found) report_error(node, fmt::format("External function '{}' not found in extern library.", symbol_name(external.name)));
+        validate_external_signature(node, external, *found);
+        external.external = found;
+        external.externs_generation = externs_generation;
     }
 
-    if (!func) report_error(node, fmt::format("External function '{}' not found in extern library.", name));
-    auto args = evaluate_argument_list(node, scope);
-    if (args.size() > 8) report_error(node, "Unable to do an external call with more than 8 arguments.");
-    if (args.empty()) return func->call();
-    if (args.size() == 1) return func->call(args[0]);
-    if (args.size() == 2) return func->call(args[0], args[1]);
-    if (args.size() == 3) return func->call(args[0], args[1], args[2]);
-    if (args.size() == 4) return func->call(args[0], args[1], args[2], args[3]);
-    if (args.size() == 5) return func->call(args[0], args[1], args[2], args[3], args[4]);
-    if (args.size() == 6) return func->call(args[0], args[1], args[2], args[3], args[4], args[5]);
-    if (args.size() == 7) return func->call(args[0], args[1], args[2], args[3], args[4], args[5], args[6]);
-    if (args.size() == 8) return func->call(args[0], args[1], args[2], args[3], args[4], args[5], args[6], args[7]);
+    if (arguments.size() != external.external->arity()) {
+        report_error(node, fmt::format("In call to external function {}: expected {} arguments, got {}",
+                                       symbol_name(external.name), external.external->arity(), arguments.size()));
+    }
+    return external.external->call(memory(), arguments);
+}
 
-    PLIB_UNREACHABLE();
+ps::value context::call_function(ps::function_handle& handle, std::span<ps::value> arguments) {
+    // Function addresses only change when restore() or reset() replace all functions, redefining a function keeps its address.
+    if (handle.generation != functions_generation) {
+        auto it = functions.find(handle.name);
+        if (it == functions.end()) {
+            report_error(nullptr, fmt::format("Function '{}' is not defined", symbol_name(handle.name)));
+            PLIB_UNREACHABLE();
+        }
+        handle.func = &it->second;
+        handle.generation = functions_generation;
+    }
+
+    function& func = *handle.func;
+    if (!func.compiled) compile_function(func);
+    // the host can change its libraries between calls, without executing a script
+    check_externs();
+    if (func.node == nullptr) {
+        return call_external(nullptr, func, arguments);
+    }
+
+    block_scope local_scope {};
+    prepare_function_scope(nullptr, &func, arguments, &local_scope);
+
+    call_frame frame { *this, function_call {.func = &func, .scope = &local_scope } };
+    return execute(func.node, &local_scope);
+}
+
+void context::validate_external_signature(ps::ast_node const* node, function const& func, ps::extern_function const& external) const {
+    // void is not a builtin type in the grammar, it is parsed as a struct name.
+    auto const declared_type = [](ps::type type, ps::symbol name) {
+        if (type != ps::type::structure) return type;
+        if (symbol_name(name) == "void") return ps::type::null;
+        return type;
+    };
+
+    // external types are declared by name too, so a struct type also matches an external type.
+    auto const matches = [](ps::type from, ps::type to) {
+        if (from == ps::type::structure && to == ps::type::external) return true;
+        if (from == ps::type::external && to == ps::type::structure) return true;
+        return may_cast(from, to);
+    };
+
+    // the parameters of variadic declarations are checked per call, against the arguments that were actually passed.
+    bool const variadic = std::any_of(func.params.begin(), func.params.end(), [](auto const& param) { return param.is_variadic; });
+    std::span<ps::type const> const expected = external.parameter_types();
+    if (!variadic && func.params.size() != expected.size()) {
+        report_error(node, fmt::format("External function {} is declared with {} parameters, but the bound function takes {}.",
+                                       symbol_name(func.name), func.params.size(), expected.size()));
+    }
+
+    for (std::size_t i = 0; !variadic && i < expected.size(); ++i) {
+        ps::type const declared = declared_type(func.params[i].type, func.params[i].type_name);
+        if (!matches(declared, expected[i])) {
+            report_error(node, fmt::format("TypeError: parameter {} of external function {} is declared as {}, but the bound function takes {}.",
+                                           symbol_name(func.params[i].name), symbol_name(func.name), type_str(declared), type_str(expected[i])));
+        }
+    }
+
+    // native structs are converted field by field, so every field of the script struct must have a matching C++ field.
+    for (ps::struct_layout const* layout : external.parameter_layouts()) {
+        if (layout == nullptr) continue;
+        auto it = structs.find(ps::intern(layout->name));
+        if (it == structs.end()) {
+            report_error(node, fmt::format("External function {} takes struct {}, but no such struct is defined.", symbol_name(func.name), layout->name));
+            PLIB_UNREACHABLE();
+        }
+
+        auto const& members = it->second.members;
+        bool matches_layout = members.size() == layout->fields.size();
+        for (std::size_t i = 0; matches_layout && i < layout->fields.size(); ++i) {
+            auto const member = std::find_if(members.begin(), members.end(), [&field = layout->fields[i]](auto const& m) {
+                return symbol_name(m.name) == field.name;
+            });
+            matches_layout = member != members.end() && member->type == layout->fields[i].type;
+        }
+        if (!matches_layout) {
+            report_error(node, fmt::format("TypeError: struct {} does not match the layout of the C++ struct it is bound to in external function {}.",
+                                           layout->name, symbol_name(func.name)));
+        }
+    }
+
+    // A declared void return type discards whatever the function returns.
+    ps::type const declared = declared_type(func.return_type, func.return_type_name);
+    ps::type const result = external.result_type();
+    if (declared == ps::type::null) return;
+    if (!matches(result, declared)) {
+        report_error(node, fmt::format("TypeError: external function {} is declared to return {}, but the bound function returns {}.",
+                                       symbol_name(func.name), type_str(declared), type_str(result)));
+    }
 }
 
-ps::value context::evaluate_list_member_function(std::string_view name, ps::variable& object, ps::Ast const* node, block_scope* scope) {
+ps::value context::evaluate_list_member_function(ps::symbol name, ps::variable& object, ps::ast_node const* node, block_scope* scope) {
     auto arguments = evaluate_argument_list(node, scope);
 
     ps::value& val = object.value();
-    if (name == "append") {
+    if (name == symbols::append) {
         if (arguments.size() != 1) {
             report_error(node, "In call to append(): expected exactly 1 argument.");
             PLIB_UNREACHABLE();
         }
         static_cast<ps::list&>(val)->append(arguments.front());
-    } else if (name == "size") {
+    } else if (name == symbols::size) {
         return ps::value::from(memory(), (int)static_cast<ps::list&>(val)->size());
     } else {
-        report_error(node, fmt::format("Unknown list member function: '{}'.", name));
+        report_error(node, fmt::format("Unknown list member function: '{}'.", symbol_name(name)));
         PLIB_UNREACHABLE();
     }
 
     return ps::value::null();
 }
 
-ps::value context::evaluate_string_member_function(std::string_view name, ps::variable& object, ps::Ast const* node, block_scope* scope) {
+ps::value context::evaluate_string_member_function(ps::symbol name, ps::variable& object, ps::ast_node const* node, block_scope* scope) {
     auto arguments = evaluate_argument_list(node, scope);
 
     ps::value& val = object.value();
     auto const& str = static_cast<ps::str const&>(val);
-    if (name == "format") {
+    if (name == symbols::format) {
         return ps::value::from(memory(), str->format(arguments));
     }
 
-    if (name == "parse_int") {
+    if (name == symbols::parse_int) {
         return ps::value::from(memory(), str->parse_int());
     }
 
-    if (name == "parse_float") {
+    if (name == symbols::parse_float) {
         return ps::value::from(memory(), str->parse_float());
     }
 
     return ps::value::null();
 }
 
-ps::value context::evaluate_builtin_function(std::string_view name, ps::Ast const* node, block_scope* scope) {
-    if (name == "ref") {
+ps::value context::evaluate_builtin_function(ps::symbol name, ps::ast_node const* node, block_scope* scope) {
+    if (name == symbols::ref) {
         // calling evaluate_argument_list with ref = true gives us a reference
         auto arguments = evaluate_argument_list(node, scope, true);
         if (arguments.size() != 1) {
@@ -1099,7 +1458,7 @@ ps::value context::evaluate_builtin_function(std::string_view name, ps::Ast cons
     auto arguments = evaluate_argument_list(node, scope);
     // builtin function: print
     // TODO: possibly allow variadics? (up to maximum amount)
-    if (name == "print") {
+    if (name == symbols::print) {
         if (arguments.size() != 1) {
             report_error(node, "In call to __print(): expected exactly one argument.");
             PLIB_UNREACHABLE();
@@ -1108,32 +1467,32 @@ ps::value context::evaluate_builtin_function(std::string_view name, ps::Ast cons
         *exec_ctx.out << to_print << std::endl;
         // success
         return ps::value::from(memory(), 0);
-    } else if (name == "readln") {
+    } else if (name == symbols::readln) {
         std::string input {};
         std::getline(*exec_ctx.in, input);
         return ps::value::from(memory(), string_type { input });
-    } else if (name == "time") {
+    } else if (name == symbols::time) {
         return ps::value::from(memory(), (unsigned int)std::time(nullptr));
-    } else if (name == "dump") {
+    } else if (name == symbols::dump) {
         dump_memory();
     } else {
-        report_error(node, fmt::format("Invalid builtin function: '{}'.", name));
+        report_error(node, fmt::format("Invalid builtin function: '{}'.", symbol_name(name)));
         PLIB_UNREACHABLE();
     }
 
     return ps::value::null();
 }
 
-ps::value context::evaluate_list(ps::Ast const* node, block_scope* scope) {
+ps::value context::evaluate_list(ps::ast_node const* node, block_scope* scope) {
    auto arguments = evaluate_argument_list(node, scope);
    return ps::value::from(memory(), ps::list_type{ arguments });
 }
 
-ps::value context::evaluate_constructor_expression(ps::Ast const* node, block_scope* scope) {
+ps::value context::evaluate_constructor_expression(ps::ast_node const* node, block_scope* scope) {
     auto arguments = evaluate_argument_list(node, scope);
     // TODO: add support for builtin types here!
-    ps::Ast const* type = find_child_with_type(node, "typename"_);
-    ps::Ast const* builtin_type = find_child_with_type(type, "builtin_type"_);
+    ps::ast_node const* type = find_child_with_type(node, "typename"_);
+    ps::ast_node const* builtin_type = find_child_with_type(type, "builtin_type"_);
     if (builtin_type) {
         std::string const name = builtin_type->token_to_string();
         if (name == "int") {
@@ -1145,39 +1504,29 @@ ps::value context::evaluate_constructor_expression(ps::Ast const* node, block_sc
         } else report_error(node, fmt::format("Cast to type '{}' is not implemented or not supported.", name));
         PLIB_UNREACHABLE();
     }
-    std::string namespace_name {};
-    ps::Ast const* namespace_list = find_child_with_type(type, "namespace_list"_);
-    if (namespace_list) {
-        for (auto const& child : namespace_list->nodes) {
-            if (node_is_type(child.get(), "namespace"_)) {
-                namespace_name += child->token_to_string() + '.';
-            }
-        }
-    }
-
-    ps::Ast const* name = find_child_with_type(type, "identifier"_);
-    std::string struct_name = namespace_name + name->token_to_string();
+    // the typename node stores the fully qualified struct name
+    ps::symbol const struct_name = type->sym;
     auto it = structs.find(struct_name);
     if (it == structs.end()) {
-        report_error(node, fmt::format("Struct '{}' not defined in current scope.", struct_name));
+        report_error(node, fmt::format("Struct '{}' not defined in current scope.", symbol_name(struct_name)));
         PLIB_UNREACHABLE();
     }
     auto const& struct_def = it->second;
-    std::unordered_map<std::string, ps::value> initializers;
+    std::unordered_map<ps::symbol, ps::value> initializers;
     for (int i = 0; i < arguments.size(); ++i) {
         ps::type given_type = arguments[i].get_type();
         ps::type expected_type = struct_def.members[i].type;
         // cast if needed
         if (!try_cast(arguments[i], given_type, expected_type)) {
             report_error(node, fmt::format("In constructor for type '{}': Cannot cast argument {} from type '{}' to '{}'.",
-                                           struct_name, i, type_str(given_type), type_str(expected_type)));
+                                           symbol_name(struct_name), i, type_str(given_type), type_str(expected_type)));
             PLIB_UNREACHABLE();
         }
         if (expected_type == ps::type::structure) {
-            auto const& init_name = static_cast<ps::structure const&>(arguments[i])->type_name();
+            auto const init_name = static_cast<ps::structure const&>(arguments[i])->type_symbol();
             if (init_name != struct_def.members[i].type_name) {
                 report_error(node, fmt::format("In constructor for type '{}': Cannot cast argument {} from type '{}' to '{}'.",
-                                               struct_name, i, init_name, struct_def.members[i].type_name));
+                                               symbol_name(struct_name), i, symbol_name(init_name), symbol_name(struct_def.members[i].type_name)));
                 PLIB_UNREACHABLE();
             }
         }
@@ -1191,41 +1540,41 @@ ps::value context::evaluate_constructor_expression(ps::Ast const* node, block_sc
     return ps::value::from(memory(), ps::struct_type { struct_name, initializers });
 }
 
-ps::value& context::index_list(ps::Ast const* node, block_scope* scope) {
-    ps::Ast const* identifier = find_child_with_type(node, "identifier"_);
-    ps::Ast const* index_expr = find_child_with_type(node, "expression"_);
+ps::value& context::index_list(ps::ast_node const* node, block_scope* scope) {
+    ps::ast_node const* identifier = find_child_with_type(node, "identifier"_);
+    ps::ast_node const* index_expr = find_child_with_type(node, "expression"_);
 
     ps::value index_expr_val = evaluate_expression(index_expr, scope);
     auto& index = static_cast<ps::integer&>(index_expr_val);
-    auto& list_val = get_variable_value(identifier->token_to_string(), identifier, scope);
+    auto& list_val = get_variable_value(identifier->sym, identifier, scope);
     auto& list = static_cast<ps::list&>(list_val);
 
     ps::value& value = list->get(index.value());
     return value;
 }
 
-ps::value& context::access_member(ps::Ast const* node, block_scope* scope) {
-    ps::Ast const* first = node->nodes[0].get();
+ps::value& context::access_member(ps::ast_node const* node, block_scope* scope) {
+    ps::ast_node const* first = &node->nodes()[0];
     ps::value* cur_val = nullptr;
     if (node_is_type(first, "identifier"_)) {
-        ps::variable& var = get_variable(first->token_to_string(), first, scope);
+        ps::variable& var = get_variable(first->sym, first, scope);
         cur_val = &var.value();
     } else if (node_is_type(first, "index_expression"_)) {
         cur_val = &index_list(first, scope);
     }
 
-    for (auto const& child : node->nodes) {
-        if (child.get() == first) continue; // skip initial node
-        if (node_is_type(child.get(), "identifier"_)) {
+    for (auto const& child : node->nodes()) {
+        if (&child == first) continue; // skip initial node
+        if (node_is_type(&child, "identifier"_)) {
             auto& as_struct = static_cast<ps::structure&>(*cur_val);
-            cur_val = &as_struct->access(child->token_to_string());
-        } else if (node_is_type(child.get(), "index_expression"_)) {
-            ps::Ast const* identifier = find_child_with_type(child.get(), "identifier"_);
+            cur_val = &as_struct->access(child.sym);
+        } else if (node_is_type(&child, "index_expression"_)) {
+            ps::ast_node const* identifier = find_child_with_type(&child, "identifier"_);
             auto& as_struct = static_cast<ps::structure&>(*cur_val);
-            auto& list = as_struct->access(identifier->token_to_string());
+            auto& list = as_struct->access(identifier->sym);
             auto& as_list = static_cast<ps::list&>(list);
 
-            ps::Ast const* index_expr = find_child_with_type(child.get(), "expression"_);
+            ps::ast_node const* index_expr = find_child_with_type(&child, "expression"_);
             ps::value index_val = evaluate_expression(index_expr, scope);
             auto& index = static_cast<ps::integer&>(index_val);
             cur_val = &as_list->get(index.value());
@@ -1234,7 +1583,7 @@ ps::value& context::access_member(ps::Ast const* node, block_scope* scope) {
     return *cur_val;
 }
 
-ps::value context::evaluate_expression(ps::Ast const* node, block_scope* scope, bool ref) {
+ps::value context::evaluate_expression(ps::ast_node const* node, block_scope* scope, bool ref) {
     // base case, an operand is a simple value.
     if (node_is_type(node, "operand"_)) {
         return evaluate_operand(node, scope, ref);
@@ -1261,9 +1610,9 @@ ps::value context::evaluate_expression(ps::Ast const* node, block_scope* scope,
     }
 
     if (node_is_type(node, "op_expression"_)) {
-        ps::Ast const* lhs_node = node->nodes[0].get();
-        ps::Ast const* operator_node = node->nodes[1].get();
-        ps::Ast const* rhs_node = node->nodes[2].get();
+        ps::ast_node const* lhs_node = &node->nodes()[0];
+        ps::ast_node const* operator_node = &node->nodes()[1];
+        ps::ast_node const* rhs_node = &node->nodes()[2];
 
         return evaluate_operator(lhs_node, operator_node, rhs_node, scope);
     }
@@ -1272,26 +1621,26 @@ ps::value context::evaluate_expression(ps::Ast const* node, block_scope* scope,
     if (node_is_type(node, "atom"_)) {
         // skip over children until we find a child node with a type that we need.
         // this is because there are parens_open and parens_close nodes in here
-        for (auto const& child : node->nodes) {
-            if (node_is_type(child.get(), "expression"_)) {
-                return evaluate_expression(child.get(), scope);
+        for (auto const& child : node->nodes()) {
+            if (node_is_type(&child, "expression"_)) {
+                return evaluate_expression(&child, scope);
             }
 
-            if (node_is_type(child.get(), "unary_operator"_)) {
-                ps::Ast const* operand = find_child_with_type(node, "operand"_);
+            if (node_is_type(&child, "unary_operator"_)) {
+                ps::ast_node const* operand = find_child_with_type(node, "operand"_);
                 if (!operand) operand = find_child_with_type(node, "access_expression"_);
                 if (!operand) operand = find_child_with_type(node, "call_expression"_);
                 if (!operand) operand = find_child_with_type(node, "index_expression"_);
                 if (!operand) operand = find_child_with_type(node, "constructor_expression"_);
-                std::string op = child->token_to_string();
+                std::string op = child.token_to_string();
                 if (op == "-") {
                     return -evaluate_expression(operand, scope);
                 } else if (op == "!") {
                     return !evaluate_expression(operand, scope);
                 } else if (op == "--") {
-                    return --get_variable_value(operand->token_to_string(), operand, scope);
+                    return --get_variable_value(operand->sym, operand, scope);
                 } else if (op == "++") {
-                    return ++get_variable_value(operand->token_to_string(), operand, scope);
+                    return ++get_variable_value(operand->sym, operand, scope);
                 } else if (op == "&") {
                     return evaluate_expression(operand, scope, true);
                 }
@@ -1313,7 +1662,7 @@ bool context::try_cast(ps::value& val, ps::type from, ps::type to) {
     return true;
 }
 
-void context::report_error(ps::Ast const* node, std::string_view message) {
+void context::report_error(ps::ast_node const* node, std::string_view message) {
     std::string error_string = "Error ";
     if (node) { // if a node was provided we can add additional source location info
         error_string += "at [" + std::to_string(node->line) + ":" + std::to_string(node->column) + "]: ";
@@ -1322,6 +1671,23 @@ void context::report_error(ps::Ast const* node, std::string_view message) {
     throw std::runtime_error(error_string);
 }
 
+function_handle::function_handle(ps::context* ctx, ps::symbol name, context::function* func, std::uint64_t generation)
+    : ctx(ctx), name(name), func(func), generation(generation) {
+
+}
+
+bool function_handle::valid() const noexcept {
+    return ctx != nullptr;
+}
+
+function_handle::operator bool() const noexcept {
+    return valid();
+}
+
+ps::value function_handle::invoke(std::span<ps::value> arguments) {
+    return ctx->call_function(*this, arguments);
+}
+
 } // namespace ps
 
 #pragma clang diagnostic pop
@@ -0,0 +1,61 @@
+#include <pscript/context_pool.hpp>
+
+namespace ps {
+
+context_pool::handle::handle(context_pool& pool, std::unique_ptr<ps::context> ctx) noexcept
+    : pool(&pool), ctx(std::move(ctx)) {
+
+}
+
+context_pool::handle& context_pool::handle::operator=(handle&& rhs) noexcept {
+    if (this != &rhs) {
+        if (ctx) pool->release(std::move(ctx));
+        pool = rhs.pool;
+        ctx = std::move(rhs.ctx);
+    }
+    return *this;
+}
+
+context_pool::handle::~handle() {
+    if (ctx) pool->release(std::move(ctx));
+}
+
+ps::context& context_pool::handle::operator*() const noexcept {
+    return *ctx;
+}
+
+ps::context* context_pool::handle::operator->() const noexcept {
+    return ctx.get();
+}
+
+context_pool::context_pool(std::size_t mem_size, ps::parser_backend backend, ps::packrat_mode packrat)
+    : mem_size(mem_size), backend(backend), packrat(packrat) {
+
+}
+
+context_pool::handle context_pool::acquire() {
+    {
+        std::lock_guard lock { mutex };
+        if (!contexts.empty()) {
+            std::unique_ptr<ps::context> ctx = std::move(contexts.back());
+            contexts.pop_back();
+            return handle { *this, std::move(ctx) };
+        }
+    }
+    // Create new contexts outside the lock, so other threads are not blocked on it.
+    return handle { *this, std::make_unique<ps::context>(mem_size, backend, packrat) };
+}
+
+std::size_t context_pool::available() const {
+    std::lock_guard lock { mutex };
+    return contexts.size();
+}
+
+void context_pool::release(std::unique_ptr<ps::context> ctx) {
+    // Reset before locking, this frees all memory the context still holds.
+    ctx->reset();
+    std::lock_guard lock { mutex };
+    contexts.push_back(std::move(ctx));
+}
+
+}
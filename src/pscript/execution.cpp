@@ -0,0 +1,209 @@
+#if defined(__APPLE__)
+// ucontext is deprecated on macOS and only declared in XSI mode, but still supported.
+#define _XOPEN_SOURCE 600
+#endif
+
+#include <pscript/execution.hpp>
+
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <ucontext.h>
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+#define PSCRIPT_SANITIZE_ADDRESS 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define PSCRIPT_SANITIZE_ADDRESS 1
+#endif
+#endif
+
+#if defined(PSCRIPT_SANITIZE_ADDRESS)
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+namespace ps {
+
+namespace {
+
+// execution whose script is running on this thread, null while the host is running.
+thread_local execution* current_execution = nullptr;
+
+// Thrown into the script when an unfinished execution is destroyed. This is not a std::exception, so the context does not report it as an error.
+struct cancelled_execution {};
+
+// Same as the default stack size of a thread on Linux, so scripts can recurse as deep as in context::execute().
+// Only the pages the script touches are backed by memory.
+constexpr std::size_t stack_size = 8 * 1024 * 1024;
+
+#if !defined(_WIN32)
+// AddressSanitizer keeps track of the stack a thread runs on, so it must be told about every switch to another stack.
+// A null fake_stack means the stack that is left is never used again.
+void start_switch([[maybe_unused]] void** fake_stack, [[maybe_unused]] void const* bottom, [[maybe_unused]] std::size_t size) {
+#if defined(PSCRIPT_SANITIZE_ADDRESS)
+    __sanitizer_start_switch_fiber(fake_stack, bottom, size);
+#endif
+}
+
+void finish_switch([[maybe_unused]] void* fake_stack, [[maybe_unused]] void const** bottom, [[maybe_unused]] std::size_t* size) {
+#if defined(PSCRIPT_SANITIZE_ADDRESS)
+    __sanitizer_finish_switch_fiber(fake_stack, bottom, size);
+#endif
+}
+#endif
+
+}
+
+// The stack of a script and the saved state of both sides. Switching between them is a plain function call on the thread that calls
+// resume(), no other thread is involved.
+struct execution::fiber {
+#if defined(_WIN32)
+    ~fiber() {
+        if (script) DeleteFiber(script);
+    }
+
+    static VOID WINAPI enter(LPVOID) {
+        execution* self = current_execution;
+        self->run();
+        // returning from a fiber exits the thread, so control goes back to the host for good.
+        SwitchToFiber(self->script_fiber->host);
+    }
+
+    void* script = nullptr;
+    void* host = nullptr;
+#else
+    static void enter() {
+        execution* self = current_execution;
+        fiber& f = *self->script_fiber;
+        finish_switch(nullptr, &f.host_bottom, &f.host_size);
+        self->run();
+        // uc_link continues the host when this returns
+        start_switch(nullptr, f.host_bottom, f.host_size);
+    }
+
+    ucontext_t script {};
+    ucontext_t host {};
+    std::unique_ptr<char[]> stack = nullptr;
+
+    // only used to tell AddressSanitizer about the stack switches
+    void const* host_bottom = nullptr;
+    std::size_t host_size = 0;
+    void* host_fake_stack = nullptr;
+    void* script_fake_stack = nullptr;
+#endif
+};
+
+void suspend_until(std::function<bool()> const& ready) {
+    execution* self = current_execution;
+    if (self == nullptr || ready()) return;
+
+    self->waiting_for = ready;
+    self->switch_to_host();
+    self->waiting_for = nullptr;
+    if (self->cancelled) throw cancelled_execution {};
+}
+
+execution::execution(ps::context& ctx, ps::script const& script, ps::execution_context exec)
+    : ctx(ctx), script(script), exec(std::move(exec)) {
+
+}
+
+execution::~execution() {
+    if (!started || done) return;
+    // let the script unwind from where it is suspended, so its call frames and values are cleaned up.
+    cancelled = true;
+    switch_to_script();
+}
+
+bool execution::resume() {
+    if (done) return true;
+    if (waiting_for && !waiting_for()) return false;
+
+    if (!started) {
+        started = true;
+        start();
+    }
+    switch_to_script();
+
+    if (error) std::rethrow_exception(std::exchange(error, nullptr));
+    return done;
+}
+
+bool execution::finished() const noexcept {
+    return done;
+}
+
+void execution::run() {
+    try {
+        ctx.execute(script, std::move(exec));
+    } catch (cancelled_execution const&) {
+        // destroyed while suspended, nobody is waiting for the result.
+    } catch (...) {
+        error = std::current_exception();
+    }
+    done = true;
+}
+
+#if defined(_WIN32)
+
+void execution::start() {
+    script_fiber = std::make_unique<fiber>();
+    // only reserve the stack, pages are committed when the script uses them
+    script_fiber->script = CreateFiberEx(0, stack_size, 0, &fiber::enter, nullptr);
+    if (!script_fiber->script) throw std::runtime_error("failed to create the stack of an execution");
+}
+
+void execution::switch_to_script() {
+    // the host side needs to be a fiber too before it can switch to one
+    if (!IsThreadAFiber()) ConvertThreadToFiber(nullptr);
+    script_fiber->host = GetCurrentFiber();
+    execution* previous = std::exchange(current_execution, this);
+    SwitchToFiber(script_fiber->script);
+    current_execution = previous;
+}
+
+void execution::switch_to_host() {
+    SwitchToFiber(script_fiber->host);
+}
+
+#else
+
+void execution::start() {
+    script_fiber = std::make_unique<fiber>();
+    // not value initialized, which would touch every page of the stack
+    script_fiber->stack = std::unique_ptr<char[]>(new char[stack_size]);
+    if (getcontext(&script_fiber->script) != 0) throw std::runtime_error("failed to create the stack of an execution");
+    script_fiber->script.uc_stack.ss_sp = script_fiber->stack.get();
+    script_fiber->script.uc_stack.ss_size = stack_size;
+    // when run() returns, control goes back to where the host last switched to the script
+    script_fiber->script.uc_link = &script_fiber->host;
+    makecontext(&script_fiber->script, &fiber::enter, 0);
+}
+
+void execution::switch_to_script() {
+    fiber& f = *script_fiber;
+    execution* previous = std::exchange(current_execution, this);
+    start_switch(&f.host_fake_stack, f.stack.get(), stack_size);
+    swapcontext(&f.host, &f.script);
+    finish_switch(f.host_fake_stack, nullptr, nullptr);
+    current_execution = previous;
+}
+
+void execution::switch_to_host() {
+    fiber& f = *script_fiber;
+    start_switch(&f.script_fake_stack, f.host_bottom, f.host_size);
+    swapcontext(&f.script, &f.host);
+    // the host may resume the script from another stack than before
+    finish_switch(f.script_fake_stack, &f.host_bottom, &f.host_size);
+}
+
+#endif
+
+}
@@ -0,0 +1,32 @@
+#include <pscript/extern_function.hpp>
+
+#include <fmt/format.h>
+
+#include <stdexcept>
+
+namespace ps {
+
+ps::value extern_function::call(ps::memory_pool& memory, std::span<ps::value const> args) const {
+    if (args.size() != param_count) {
+        throw std::runtime_error(fmt::format("expected {} arguments, got {}", param_count, args.size()));
+    }
+    return thunk(object.get(), memory, args);
+}
+
+std::size_t extern_function::arity() const noexcept {
+    return param_count;
+}
+
+std::span<ps::type const> extern_function::parameter_types() const noexcept {
+    return { param_types, param_count };
+}
+
+std::span<ps::struct_layout const* const> extern_function::parameter_layouts() const noexcept {
+    return { param_layouts, param_count };
+}
+
+ps::type extern_function::result_type() const noexcept {
+    return return_type;
+}
+
+}
@@ -0,0 +1,63 @@
+#include <pscript/extern_registry.hpp>
+
+#include <unordered_set>
+
+namespace ps {
+
+extern_registry::extern_registry(std::unique_ptr<extern_library> chain) : libraries(std::move(chain)) {
+    std::vector<std::string> function_keys {};
+    std::vector<std::string> variable_keys {};
+    // names that were already added by an earlier library in the chain
+    std::unordered_set<std::string> seen_functions {};
+    std::unordered_set<std::string> seen_variables {};
+
+    for (extern_library const* cur = libraries.get(); cur != nullptr; cur = cur->next.get()) {
+        cur->enumerate(
+            [&](std::string const& name, ps::extern_function const* function) {
+                if (!seen_functions.insert(name).second) return;
+                function_keys.push_back(name);
+                functions.push_back(function);
+            },
+            [&](std::string const& name, void* variable) {
+                if (!seen_variables.insert(name).second) return;
+                variable_keys.push_back(name);
+                variables.push_back(variable);
+            });
+    }
+
+    function_names = ps::perfect_hash { std::move(function_keys) };
+    variable_names = ps::perfect_hash { std::move(variable_keys) };
+}
+
+ps::extern_function const* extern_registry::get_function(std::string const& name) {
+    std::size_t const index = function_names.find(name);
+    if (index != ps::perfect_hash::npos) return functions[index];
+    // not in the table, ask the libraries themselves. This finds functions of libraries that do not enumerate them.
+    for (extern_library* cur = libraries.get(); cur != nullptr; cur = cur->next.get()) {
+        if (ps::extern_function const* function = cur->get_function(name)) return function;
+    }
+    return extern_library::get_function(name);
+}
+
+void* extern_registry::get_variable(std::string const& name) {
+    std::size_t const index = variable_names.find(name);
+    if (index != ps::perfect_hash::npos) return variables[index];
+    for (extern_library* cur = libraries.get(); cur != nullptr; cur = cur->next.get()) {
+        if (void* variable = cur->get_variable(name)) return variable;
+    }
+    return extern_library::get_variable(name);
+}
+
+void extern_registry::enumerate(std::function<void(std::string const&, ps::extern_function const*)> const& on_function,
+                                std::function<void(std::string const&, void*)> const& on_variable) const {
+    for (extern_library const* cur = libraries.get(); cur != nullptr; cur = cur->next.get()) {
+        cur->enumerate(on_function, on_variable);
+    }
+    extern_library::enumerate(on_function, on_variable);
+}
+
+std::unique_ptr<extern_library> extern_library_chain_builder::build() {
+    return std::make_unique<ps::extern_registry>(std::move(lib));
+}
+
+}
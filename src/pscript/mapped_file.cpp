@@ -0,0 +1,104 @@
+#include <pscript/mapped_file.hpp>
+
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace ps {
+
+// Maps an entire file read-only, returns nullptr on failure.
+static void const* map_file(fs::path const& path, std::size_t size) {
+#if defined(_WIN32)
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+    // the view keeps the mapping alive
+    void const* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    CloseHandle(mapping);
+    return view;
+#else
+    int const fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    void* view = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after closing the file
+    ::close(fd);
+    if (view == MAP_FAILED) return nullptr;
+    return view;
+#endif
+}
+
+mapped_file::mapped_file(fs::path const& path) {
+    std::error_code error {};
+    std::size_t const size = fs::file_size(path, error);
+    if (error) throw std::runtime_error("failed to open file " + path.string() + ": " + error.message());
+
+    if (size >= mapping_threshold) {
+        mapping = map_file(path, size);
+        if (!mapping) throw std::runtime_error("failed to map file " + path.string());
+        mapping_size = size;
+        return;
+    }
+
+    std::ifstream in { path, std::ios::binary };
+    if (!in.is_open()) throw std::runtime_error("failed to open file " + path.string());
+    buffer.resize(size);
+    in.read(buffer.data(), static_cast<std::streamsize>(size));
+    // the file may have been changed after checking its size
+    buffer.resize(static_cast<std::size_t>(in.gcount()));
+}
+
+mapped_file::mapped_file(mapped_file&& rhs) noexcept
+    : buffer(std::move(rhs.buffer)), mapping(std::exchange(rhs.mapping, nullptr)), mapping_size(std::exchange(rhs.mapping_size, 0)) {
+
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& rhs) noexcept {
+    if (this != &rhs) {
+        unmap();
+        buffer = std::move(rhs.buffer);
+        mapping = std::exchange(rhs.mapping, nullptr);
+        mapping_size = std::exchange(rhs.mapping_size, 0);
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file() {
+    unmap();
+}
+
+std::string_view mapped_file::contents() const noexcept {
+    if (mapping) return { static_cast<char const*>(mapping), mapping_size };
+    return buffer;
+}
+
+bool mapped_file::is_mapped() const noexcept {
+    return mapping != nullptr;
+}
+
+void mapped_file::unmap() noexcept {
+    if (!mapping) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(mapping);
+#else
+    ::munmap(const_cast<void*>(mapping), mapping_size);
+#endif
+    mapping = nullptr;
+    mapping_size = 0;
+}
+
+}
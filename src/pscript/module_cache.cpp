@@ -0,0 +1,173 @@
+#include <pscript/module_cache.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+
+#if defined(__GLIBCXX__) && defined(__linux__)
+    #include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace ps {
+
+// Reads the modification time and size of a regular file with a single stat call, returns false if it is not one.
+// directory_entry caches these on construction with most standard libraries, but libstdc++ only caches the file type
+// and stats the file again for every other attribute, so the stat is done directly there.
+static bool stat_regular_file(fs::path const& path, fs::file_time_type& write_time, std::uintmax_t& size) {
+#if defined(__GLIBCXX__) && defined(__linux__)
+    struct stat status {};
+    if (::stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) return false;
+    auto const since_epoch = std::chrono::seconds(status.st_mtim.tv_sec) + std::chrono::nanoseconds(status.st_mtim.tv_nsec);
+    write_time = std::chrono::file_clock::from_sys(
+        std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(since_epoch)));
+    size = static_cast<std::uintmax_t>(status.st_size);
+    return true;
+#else
+    std::error_code error {};
+    fs::directory_entry const file { path, error };
+    if (error || !file.is_regular_file(error)) return false;
+    write_time = file.last_write_time(error);
+    size = file.file_size(error);
+    return !error;
+#endif
+}
+
+static std::shared_ptr<ps::script const> load_precompiled(std::string const& path, fs::file_time_type source_time) {
+    fs::file_time_type precompiled_time {};
+    std::uintmax_t size = 0;
+    if (!stat_regular_file(path, precompiled_time, size) || precompiled_time < source_time) return nullptr;
+
+    std::ifstream in { path, std::ios::binary };
+    if (!in.is_open()) return nullptr;
+    try {
+        return std::make_shared<ps::script>(in);
+    } catch (std::runtime_error const&) {
+        // written by a different version, the source will be parsed instead
+        return nullptr;
+    }
+}
+
+module_cache& module_cache::global() {
+    static module_cache cache {};
+    return cache;
+}
+
+std::string module_cache::resolve(std::string const& module, std::vector<std::string> const& module_paths) {
+    std::string key {};
+    for (auto const& path : module_paths) {
+        key += path;
+        key += '\0';
+    }
+    key += module;
+
+    {
+        std::shared_lock lock { mutex };
+        auto it = resolved_paths.find(key);
+        if (it != resolved_paths.end()) return it->second;
+    }
+
+    // std.io -> std/io.ps
+    std::string relative_path = module;
+    std::replace(relative_path.begin(), relative_path.end(), '.', '/');
+    relative_path += ".ps";
+
+    for (auto const& path : module_paths) {
+        fs::path const candidate = fs::path(path) / relative_path;
+        fs::file_time_type write_time {};
+        std::uintmax_t size = 0;
+        if (!stat_regular_file(candidate, write_time, size)) continue;
+
+        // only the module that is found is canonicalized
+        std::error_code error {};
+        std::string canonical = fs::weakly_canonical(candidate, error).generic_string();
+        if (error) canonical = candidate.generic_string();
+
+        std::unique_lock lock { mutex };
+        resolved_paths[key] = canonical;
+        return canonical;
+    }
+
+    // Modules that were not found are not remembered, they might still be created later.
+    return {};
+}
+
+std::shared_ptr<ps::script const> module_cache::load(std::string const& filepath, ps::context& ctx) {
+    entry latest {};
+    if (!stat_regular_file(filepath, latest.write_time, latest.size)) return nullptr;
+
+    {
+        std::shared_lock lock { mutex };
+        auto it = modules.find(filepath);
+        if (it != modules.end() && it->second.write_time == latest.write_time && it->second.size == latest.size) {
+            return it->second.script;
+        }
+    }
+
+    // Load without holding the lock, so other modules can be loaded at the same time.
+    latest.script = load_precompiled(filepath + 'c', latest.write_time);
+    if (!latest.script) {
+        ps::mapped_file source {};
+        try {
+            source = ps::mapped_file(filepath);
+        } catch (std::runtime_error const&) {
+            return nullptr;
+        }
+        latest.script = std::make_shared<ps::script>(std::move(source), ctx);
+    }
+
+    std::unique_lock lock { mutex };
+    // If another thread loaded the same version of this module in the meantime, use that one so all contexts share it.
+    auto& cached = modules[filepath];
+    if (!cached.script || cached.write_time != latest.write_time || cached.size != latest.size) {
+        cached = std::move(latest);
+    }
+    return cached.script;
+}
+
+void module_cache::preload(ps::script const& script, std::vector<std::string> const& module_paths, ps::context& ctx) {
+    std::unordered_set<std::string> visited {};
+    std::vector<std::string> imports = script.imports();
+    while (!imports.empty()) {
+        // Modules that are cached are not checked for changes here, this is done when they are actually imported.
+        std::vector<std::string> uncached {};
+        std::vector<std::shared_ptr<ps::script const>> level {};
+        for (auto const& name : imports) {
+            std::string path = resolve(name, module_paths);
+            if (path.empty() || !visited.insert(path).second) continue;
+
+            std::shared_lock lock { mutex };
+            auto it = modules.find(path);
+            if (it != modules.end()) level.push_back(it->second.script);
+            else uncached.push_back(std::move(path));
+        }
+
+        std::vector<std::shared_ptr<ps::script const>> loaded(uncached.size());
+        pool.parallel_for(uncached.size(), [&](std::size_t i) {
+            try {
+                loaded[i] = load(uncached[i], ctx);
+            } catch (std::exception const&) {
+                // reported when the module is imported
+            }
+        });
+        level.insert(level.end(), loaded.begin(), loaded.end());
+
+        imports.clear();
+        for (auto const& loaded_script : level) {
+            if (!loaded_script) continue;
+            imports.insert(imports.end(), loaded_script->imports().begin(), loaded_script->imports().end());
+        }
+    }
+}
+
+void module_cache::clear() {
+    std::unique_lock lock { mutex };
+    modules.clear();
+    resolved_paths.clear();
+}
+
+}
@@ -0,0 +1,813 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+#include <pscript/parser.hpp>
+
+#include <peglib.h>
+
+#include <algorithm>
+#include <initializer_list>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace ps {
+
+// The native parser implements the grammar in context.cpp rule by rule, following the same matching rules as peglib:
+// - Alternatives are tried in order, and the first one that matches is taken.
+// - Every rule reference creates a node named after the rule. Literals do not create nodes.
+// - Rules without references to other rules, rules inside < > and rules that only consist of literals are tokens.
+//   Token nodes have no children and store the matched text.
+// - Whitespace is skipped after every literal and every < > token, unless this happens inside another < > token.
+//   Character classes (used by identifier for example) do not skip whitespace.
+// - Nodes with a single child are replaced by that child, unless the rule is marked no_ast_opt. The child keeps its own name,
+//   and gets the name of the rule it replaced as its original name (this is what peglib's optimize_ast does).
+// Because of this, the interpreter cannot tell the difference between an AST created by peglib and one created by this parser.
+
+// A node that has been parsed, but not added to the tree yet. Nodes are only added once parsing succeeds, and it is known
+// whether they are replaced by their only child.
+struct pending_node {
+    char const* name = nullptr;
+    char const* original_name = nullptr;
+    std::size_t begin = 0;
+    bool is_token = false;
+    std::string_view token {};
+    // children are stored in native_parser::finished
+    std::uint32_t first_child = 0;
+    std::uint32_t child_count = 0;
+};
+
+using node_list = std::vector<pending_node>;
+
+class native_parser {
+public:
+    native_parser(std::string_view source, ps::packrat_mode mode) : src(source), packrat(mode) {
+        line_starts.push_back(0);
+        line_is_ascii.push_back(true);
+        for (std::size_t i = 0; i < src.size(); ++i) {
+            if (src[i] == '\n') {
+                line_starts.push_back(i + 1);
+                line_is_ascii.push_back(true);
+            } else if (static_cast<unsigned char>(src[i]) >= 0x80) {
+                line_is_ascii.back() = false;
+            }
+        }
+    }
+
+    ps::syntax_tree parse(ps::parse_stats* stats) {
+        skip_whitespace();
+        node_list root {};
+        ps::syntax_tree tree {};
+        if (script(root) && pos == src.size()) tree = build(root.front());
+
+        if (stats) {
+            stats->packrat = packrat != ps::packrat_mode::off;
+            stats->memo_entries = memo_stores;
+            // everything is still alive once the tree is built, so this is the peak
+            stats->peak_bytes = tree.memory_usage() + finished.capacity() * sizeof(pending_node)
+                + root.capacity() * sizeof(pending_node) + line_starts.capacity() * sizeof(std::size_t)
+                + line_is_ascii.capacity() / 8;
+            for (memo_table const* memo : { &expression_memo, &atom_memo, &index_expression_memo, &call_expression_memo, &access_expression_memo }) {
+                stats->peak_bytes += memo->memory_usage();
+            }
+        }
+        return tree;
+    }
+
+private:
+    std::string_view src;
+    std::size_t pos = 0;
+    // amount of < > tokens currently being parsed, whitespace is not skipped inside them
+    int token_depth = 0;
+    std::vector<std::size_t> line_starts {};
+    // on lines without multibyte characters, columns can be computed without counting code points
+    std::vector<bool> line_is_ascii {};
+    // Children of pending nodes, the children of a node are stored next to each other. Nodes that are discarded
+    // when backtracking stay here until parsing is done.
+    std::vector<pending_node> finished {};
+
+    struct memo_entry {
+        std::size_t begin = std::numeric_limits<std::size_t>::max();
+        bool success = false;
+        std::size_t end = 0;
+        pending_node node {};
+    };
+
+    // Results of a single rule by position.
+    // In packrat_mode::on every result is remembered, like a packrat parser does. In packrat_mode::adaptive this is a small
+    // direct mapped cache instead: a rule is only tried again at the same position shortly after it was tried the first time
+    // (when backtracking), so there is no need to remember every result.
+    class memo_table {
+    public:
+        static constexpr std::size_t cache_size = 64;
+
+        memo_table(ps::packrat_mode mode, std::size_t source_size) {
+            if (mode == ps::packrat_mode::adaptive) entries.resize(cache_size);
+            else if (mode == ps::packrat_mode::on) positions.resize(source_size + 1, 0);
+        }
+
+        [[nodiscard]] memo_entry const* find(std::size_t begin) const {
+            if (!positions.empty()) {
+                std::uint32_t const index = positions[begin];
+                return index == 0 ? nullptr : &entries[index - 1];
+            }
+            memo_entry const& entry = entries[begin % cache_size];
+            return entry.begin == begin ? &entry : nullptr;
+        }
+
+        void store(memo_entry const& entry) {
+            if (!positions.empty()) {
+                entries.push_back(entry);
+                positions[entry.begin] = static_cast<std::uint32_t>(entries.size());
+            } else {
+                entries[entry.begin % cache_size] = entry;
+            }
+        }
+
+        [[nodiscard]] std::size_t memory_usage() const {
+            return entries.capacity() * sizeof(memo_entry) + positions.capacity() * sizeof(std::uint32_t);
+        }
+
+    private:
+        std::vector<memo_entry> entries {};
+        // index + 1 into entries for every position, only used when every result is remembered
+        std::vector<std::uint32_t> positions {};
+    };
+
+    ps::packrat_mode packrat;
+    // amount of results stored in all memo tables
+    std::size_t memo_stores = 0;
+
+    // Expressions are tried in several places at the same position, remember the result of the most expensive rules.
+    // Without this, nested expressions would take exponential time to parse.
+    memo_table expression_memo { packrat, src.size() };
+    memo_table atom_memo { packrat, src.size() };
+    memo_table index_expression_memo { packrat, src.size() };
+    memo_table call_expression_memo { packrat, src.size() };
+    memo_table access_expression_memo { packrat, src.size() };
+
+    // ================= node creation =================
+
+    // Same as peglib's line_info: lines start at 1, columns count code points starting at 1.
+    std::pair<std::size_t, std::size_t> line_info(std::size_t offset) const {
+        auto it = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+        std::size_t const line = static_cast<std::size_t>(it - line_starts.begin());
+        std::size_t const line_start = *(it - 1);
+        if (line_is_ascii[line - 1]) return { line, offset - line_start + 1 };
+        std::size_t column = 1;
+        for (std::size_t i = line_start; i < offset; ++i) {
+            // skip UTF-8 continuation bytes
+            if ((static_cast<unsigned char>(src[i]) & 0xC0) != 0x80) ++column;
+        }
+        return { line, column };
+    }
+
+    // Adds the pending nodes to a tree in breadth first order.
+    ps::syntax_tree build(pending_node const& root) const {
+        // find all nodes first, so the tree can be allocated at once
+        std::vector<pending_node const*> order { &root };
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            for (std::uint32_t child = 0; child < order[i]->child_count; ++child) {
+                order.push_back(&finished[order[i]->first_child + child]);
+            }
+        }
+
+        ps::syntax_tree tree {};
+        tree.reserve(order.size());
+        tree.add_root();
+        for (std::uint32_t index = 0; index < order.size(); ++index) {
+            pending_node const* pending = order[index];
+            auto const [line, column] = line_info(pending->begin);
+            ps::ast_node& node = tree.node(index);
+            node.tag = peg::str2tag(pending->name);
+            node.original_tag = peg::str2tag(pending->original_name);
+            node.line = static_cast<std::uint32_t>(line);
+            node.column = static_cast<std::uint32_t>(column);
+            node.is_token = pending->is_token;
+            node.token = pending->token;
+
+            // children are added in the same order as they are in order
+            if (pending->child_count != 0) tree.add_children(index, pending->child_count);
+        }
+        return tree;
+    }
+
+    // Replaces the nodes in out starting at mark by a single node that has them as children.
+    void add_node(char const* name, bool no_ast_opt, std::size_t begin, std::size_t mark, node_list& out) {
+        std::size_t const count = out.size() - mark;
+        if (!no_ast_opt && count == 1) {
+            out.back().original_name = name;
+            return;
+        }
+
+        pending_node node { name, name, begin, false, {}, static_cast<std::uint32_t>(finished.size()), static_cast<std::uint32_t>(count) };
+        finished.insert(finished.end(), out.begin() + static_cast<std::ptrdiff_t>(mark), out.end());
+        out.resize(mark);
+        out.push_back(node);
+    }
+
+    // ================= matching primitives =================
+
+    static bool is_whitespace(char c) {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+    }
+
+    static bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool is_alpha(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    void skip_whitespace() {
+        if (token_depth > 0) return;
+        while (pos < src.size() && is_whitespace(src[pos])) ++pos;
+    }
+
+    bool literal(std::string_view text) {
+        if (src.substr(pos, text.size()) != text) return false;
+        pos += text.size();
+        skip_whitespace();
+        return true;
+    }
+
+    bool digits() {
+        std::size_t const begin = pos;
+        while (pos < src.size() && is_digit(src[pos])) ++pos;
+        return pos != begin;
+    }
+
+    // matches a single code point, like '.' in the grammar
+    bool any_character() {
+        if (pos >= src.size()) return false;
+        auto const c = static_cast<unsigned char>(src[pos]);
+        std::size_t length = 1;
+        if ((c & 0xE0) == 0xC0) length = 2;
+        else if ((c & 0xF0) == 0xE0) length = 3;
+        else if ((c & 0xF8) == 0xF0) length = 4;
+        if (length > src.size() - pos) return false;
+        pos += length;
+        return true;
+    }
+
+    // Matches a sequence, restores the position and removes added nodes if it does not match.
+    template<typename F>
+    bool group(node_list& out, F&& body) {
+        std::size_t const begin = pos;
+        std::size_t const size = out.size();
+        if (body()) return true;
+        pos = begin;
+        out.resize(size);
+        return false;
+    }
+
+    template<typename F>
+    bool zero_or_more(F&& body) {
+        while (true) {
+            std::size_t const begin = pos;
+            if (!body() || pos == begin) break;
+        }
+        return true;
+    }
+
+    template<typename F>
+    bool one_or_more(F&& body) {
+        if (!body()) return false;
+        return zero_or_more(body);
+    }
+
+    // A rule that is not a token. body(out) adds the nodes of referenced rules to out, these become the children of the new node.
+    template<typename F>
+    bool rule(char const* name, bool no_ast_opt, node_list& out, F&& body) {
+        std::size_t const begin = pos;
+        std::size_t const mark = out.size();
+        if (!body(out)) {
+            pos = begin;
+            out.resize(mark);
+            return false;
+        }
+        add_node(name, no_ast_opt, begin, mark, out);
+        return true;
+    }
+
+    // A token rule without < >, the token is the entire match.
+    template<typename F>
+    bool token_rule(char const* name, node_list& out, F&& body) {
+        std::size_t const begin = pos;
+        if (!body()) {
+            pos = begin;
+            return false;
+        }
+        out.push_back(pending_node { name, name, begin, true, src.substr(begin, pos - begin) });
+        return true;
+    }
+
+    // A rule of the form < ... >. The token does not include the whitespace skipped after it.
+    template<typename F>
+    bool boundary_rule(char const* name, node_list& out, F&& body) {
+        std::size_t const begin = pos;
+        ++token_depth;
+        bool const success = body();
+        --token_depth;
+        if (!success) {
+            pos = begin;
+            return false;
+        }
+        std::string_view const token = src.substr(begin, pos - begin);
+        skip_whitespace();
+        out.push_back(pending_node { name, name, begin, true, token });
+        return true;
+    }
+
+    // A rule that only consists of literals, peglib turns these into < > tokens.
+    bool literal_rule(char const* name, node_list& out, std::initializer_list<std::string_view> alternatives) {
+        return boundary_rule(name, out, [&]() {
+            return std::any_of(alternatives.begin(), alternatives.end(), [this](std::string_view alt) { return literal(alt); });
+        });
+    }
+
+    template<typename F>
+    bool memoized(memo_table& memo, node_list& out, F&& parse) {
+        if (packrat == ps::packrat_mode::off) return parse(out);
+
+        std::size_t const begin = pos;
+        if (memo_entry const* entry = memo.find(begin)) {
+            if (!entry->success) return false;
+            pos = entry->end;
+            out.push_back(entry->node);
+            return true;
+        }
+
+        std::size_t const mark = out.size();
+        bool const success = parse(out);
+        memo.store(memo_entry { begin, success, pos, success ? out[mark] : pending_node {} });
+        ++memo_stores;
+        return success;
+    }
+
+    // ================= base content =================
+
+    bool script(node_list& out) {
+        return rule("script", false, out, [&](node_list& c) { return content(c); });
+    }
+
+    bool content(node_list& out) {
+        return rule("content", true, out, [&](node_list& c) {
+            return zero_or_more([&]() {
+                return extern_var(c) || comment(c) || element(c) || namespace_decl(c) || function(c) || struct_(c);
+            });
+        });
+    }
+
+    // ================= basic syntactical symbols =================
+
+    bool space(node_list& out) {
+        return token_rule("space", out, [&]() {
+            while (pos < src.size() && src[pos] == ' ') ++pos;
+            return true;
+        });
+    }
+
+    bool operator_(node_list& out) {
+        return literal_rule("operator", out, { "&&", "||", "%", "&", "<<", ">>", "^", "+=", "-=", "*=", "/=", "<=", ">=",
+                                               "==", "!=", "*", "/", "+", "-", "<", ">", "=" });
+    }
+
+    bool unary_operator(node_list& out) { return literal_rule("unary_operator", out, { "&", "--", "-", "++", "!" }); }
+    bool assign(node_list& out) { return literal_rule("assign", out, { "=" }); }
+    bool colon(node_list& out) { return literal_rule("colon", out, { ":" }); }
+    bool quote(node_list& out) { return literal_rule("quote", out, { "\"" }); }
+    bool parens_open(node_list& out) { return literal_rule("parens_open", out, { "(" }); }
+    bool parens_close(node_list& out) { return literal_rule("parens_close", out, { ")" }); }
+    bool brace_open(node_list& out) { return literal_rule("brace_open", out, { "{" }); }
+    bool brace_close(node_list& out) { return literal_rule("brace_close", out, { "}" }); }
+    bool list_open(node_list& out) { return literal_rule("list_open", out, { "[" }); }
+    bool list_close(node_list& out) { return literal_rule("list_close", out, { "]" }); }
+    bool arrow(node_list& out) { return literal_rule("arrow", out, { "->" }); }
+    bool dot(node_list& out) { return literal_rule("dot", out, { "." }); }
+    bool comma(node_list& out) { return literal_rule("comma", out, { "," }); }
+    bool semicolon(node_list& out) { return literal_rule("semicolon", out, { ";" }); }
+
+    bool any(node_list& out) {
+        return token_rule("any", out, [&]() {
+            constexpr std::string_view allowed = ".,:;&_+*/=?!(){}<> []-";
+            while (pos < src.size() && (is_alpha(src[pos]) || is_digit(src[pos]) || allowed.find(src[pos]) != std::string_view::npos)) {
+                ++pos;
+            }
+            return true;
+        });
+    }
+
+    // ================= identifiers and literals =================
+
+    bool identifier(node_list& out) {
+        return token_rule("identifier", out, [&]() {
+            if (pos >= src.size() || !is_alpha(src[pos])) return false;
+            ++pos;
+            while (pos < src.size() && (is_alpha(src[pos]) || is_digit(src[pos]) || src[pos] == '_')) ++pos;
+            return true;
+        });
+    }
+
+    bool literal_(node_list& out) {
+        return rule("literal", false, out, [&](node_list& c) { return boolean(c) || string(c) || number(c); });
+    }
+
+    bool number(node_list& out) {
+        return rule("number", false, out, [&](node_list& c) {
+            if (!float_(c) && !integer(c)) return false;
+            literal_rule("literal_suffix", c, { "u" });
+            return true;
+        });
+    }
+
+    bool integer(node_list& out) {
+        return boundary_rule("integer", out, [&]() { return digits(); });
+    }
+
+    bool float_(node_list& out) {
+        return boundary_rule("float", out, [&]() { return digits() && any_character() && digits(); });
+    }
+
+    bool string(node_list& out) {
+        std::size_t const mark = out.size();
+        return boundary_rule("string", out, [&]() {
+            // only the token itself is kept
+            bool const matched = quote(out) && any(out) && quote(out);
+            out.resize(mark);
+            return matched;
+        });
+    }
+
+    bool boolean(node_list& out) {
+        return boundary_rule("boolean", out, [&]() { return literal("true") || literal("false"); });
+    }
+
+    // ================= typenames =================
+
+    bool typename_(node_list& out) {
+        return rule("typename", true, out, [&](node_list& c) {
+            bool const type = literal_rule("builtin_type", c, { "uint", "int", "float", "bool", "str", "list", "any" }) || group(c, [&]() {
+                namespace_list(c);
+                return identifier(c);
+            });
+            if (!type) return false;
+            literal_rule("ampersand", c, { "&" });
+            return true;
+        });
+    }
+
+    bool namespace_list(node_list& out) {
+        return rule("namespace_list", true, out, [&](node_list& c) {
+            return one_or_more([&]() {
+                return group(c, [&]() {
+                    return rule("namespace", false, c, [&](node_list& ns) { return identifier(ns); }) && literal(".");
+                });
+            });
+        });
+    }
+
+    // ================= namespaces =================
+
+    bool namespace_decl(node_list& out) {
+        return rule("namespace_decl", false, out, [&](node_list& c) {
+            return literal("namespace ") && identifier(c) && space(c) && brace_open(c) && content(c) && brace_close(c);
+        });
+    }
+
+    // ================= external variables =================
+
+    bool extern_var(node_list& out) {
+        return rule("extern_var", false, out, [&](node_list& c) {
+            return literal("extern let ") && identifier(c) && space(c) && arrow(c) && typename_(c) && semicolon(c);
+        });
+    }
+
+    // ================= functions =================
+
+    bool parameter_list(node_list& out) {
+        return rule("parameter_list", true, out, [&](node_list& c) {
+            return variadic(c) || group(c, [&]() {
+                if (!parameter(c)) return false;
+                zero_or_more([&]() { return group(c, [&]() { return comma(c) && parameter(c); }); });
+                group(c, [&]() { return comma(c) && variadic(c); });
+                return true;
+            });
+        });
+    }
+
+    bool parameter(node_list& out) {
+        return rule("parameter", false, out, [&](node_list& c) { return identifier(c) && colon(c) && typename_(c); });
+    }
+
+    bool variadic(node_list& out) {
+        return rule("variadic", true, out, [&](node_list& c) { return identifier(c) && literal("..."); });
+    }
+
+    bool function(node_list& out) {
+        return rule("function", false, out, [&](node_list& c) { return function_ext(c) || function_def(c); });
+    }
+
+    bool function_ext(node_list& out) {
+        return rule("function_ext", false, out, [&](node_list& c) {
+            if (!literal("extern fn ") || !identifier(c) || !parens_open(c)) return false;
+            parameter_list(c);
+            return parens_close(c) && arrow(c) && typename_(c) && semicolon(c);
+        });
+    }
+
+    bool function_def(node_list& out) {
+        return rule("function_def", false, out, [&](node_list& c) {
+            if (!literal("fn ") || !identifier(c) || !parens_open(c)) return false;
+            parameter_list(c);
+            return parens_close(c) && arrow(c) && typename_(c) && space(c) && compound(c);
+        });
+    }
+
+    bool builtin_function(node_list& out) {
+        return rule("builtin_function", false, out, [&](node_list& c) { return literal("__") && identifier(c); });
+    }
+
+    // ================= structs =================
+
+    bool struct_(node_list& out) {
+        return rule("struct", false, out, [&](node_list& c) {
+            return literal("struct ") && identifier(c) && space(c) && brace_open(c) && struct_items(c) && brace_close(c) && semicolon(c);
+        });
+    }
+
+    bool struct_items(node_list& out) {
+        return rule("struct_items", false, out, [&](node_list& c) {
+            return zero_or_more([&]() {
+                return group(c, [&]() { return struct_item(c) && semicolon(c); }) || comment(c);
+            });
+        });
+    }
+
+    bool struct_item(node_list& out) {
+        return rule("struct_item", false, out, [&](node_list& c) {
+            return identifier(c) && colon(c) && typename_(c) && rule("struct_initializer", false, c, [&](node_list& init) {
+                return assign(init) && expression(init);
+            });
+        });
+    }
+
+    bool element(node_list& out) {
+        return rule("element", false, out, [&](node_list& c) {
+            return comment(c) || statement(c) || if_(c) || while_(c) || for_(c);
+        });
+    }
+
+    // ================= statements =================
+
+    bool statement(node_list& out) {
+        return rule("statement", false, out, [&](node_list& c) { return statement_base(c) && semicolon(c); });
+    }
+
+    bool statement_base(node_list& out) {
+        return rule("statement_base", false, out, [&](node_list& c) {
+            return import_(c) || delete_(c) || return_(c) || declaration(c) || expression(c);
+        });
+    }
+
+    bool import_(node_list& out) {
+        return rule("import", true, out, [&](node_list& c) {
+            if (!literal("import ")) return false;
+            zero_or_more([&]() {
+                return group(c, [&]() {
+                    return rule("module_folder", false, c, [&](node_list& folder) { return identifier(folder); }) && dot(c);
+                });
+            });
+            return rule("module_name", false, c, [&](node_list& name) { return identifier(name); });
+        });
+    }
+
+    bool delete_(node_list& out) {
+        return rule("delete", true, out, [&](node_list& c) { return literal("delete ") && identifier(c); });
+    }
+
+    bool return_(node_list& out) {
+        return rule("return", true, out, [&](node_list& c) {
+            if (!literal("return")) return false;
+            expression(c);
+            return true;
+        });
+    }
+
+    bool declaration(node_list& out) {
+        return rule("declaration", false, out, [&](node_list& c) {
+            return literal("let ") && identifier(c) && space(c) && assign(c) && space(c) && expression(c);
+        });
+    }
+
+    bool compound(node_list& out) {
+        return rule("compound", true, out, [&](node_list& c) {
+            return element(c) || group(c, [&]() {
+                if (!brace_open(c)) return false;
+                zero_or_more([&]() { return element(c); });
+                return brace_close(c);
+            });
+        });
+    }
+
+    // ================= expressions =================
+
+    bool expression(node_list& out) {
+        return memoized(expression_memo, out, [&](node_list& result) {
+            return rule("expression", false, result, [&](node_list& c) {
+                return constructor_expression(c) || op_expression(c) || index_expression(c) || list_expression(c) ||
+                       call_expression(c) || access_expression(c);
+            });
+        });
+    }
+
+    bool constructor_expression(node_list& out) {
+        return rule("constructor_expression", false, out, [&](node_list& c) {
+            if (!typename_(c) || !space(c) || !literal("{")) return false;
+            argument_list(c);
+            return literal("}");
+        });
+    }
+
+    bool list_expression(node_list& out) {
+        return rule("list_expression", false, out, [&](node_list& c) {
+            if (!list_open(c)) return false;
+            argument_list(c);
+            return list_close(c);
+        });
+    }
+
+    // Operator precedence, the same table as in the grammar. Higher binds stronger, all operators are left associative.
+    static int precedence(std::string_view op) {
+        static std::unordered_map<std::string_view, int> const levels = {
+            { "=", 1 }, { "+=", 1 }, { "-=", 1 }, { "*=", 1 }, { "/=", 1 },
+            { "&&", 2 }, { "||", 2 },
+            { "==", 3 }, { "!=", 3 }, { "<=", 3 }, { ">=", 3 }, { "<", 3 }, { ">", 3 },
+            { "-", 4 }, { "+", 4 }, { "<<", 4 }, { ">>", 4 }, { "^", 4 }, { "&", 4 }, { "%", 4 },
+            { "/", 5 }, { "*", 5 }
+        };
+        auto it = levels.find(op);
+        return it == levels.end() ? 0 : it->second;
+    }
+
+    bool op_expression(node_list& out) {
+        return rule("op_expression", false, out, [&](node_list& c) { return binary_expression(c, 0); });
+    }
+
+    // Precedence climbing like peglib does it: every operator creates an op_expression node with the left hand side,
+    // the operator and the right hand side as children. If an operator is not followed by a valid right hand side
+    // the entire expression fails to match.
+    bool binary_expression(node_list& out, int min_precedence) {
+        std::size_t const begin = pos;
+        std::size_t const mark = out.size();
+        if (!atom(out)) return false;
+
+        while (pos < src.size()) {
+            std::size_t const operator_begin = pos;
+            if (!operator_(out)) break;
+            int const level = precedence(out.back().token);
+            if (level < min_precedence) {
+                pos = operator_begin;
+                out.pop_back();
+                break;
+            }
+
+            if (!binary_expression(out, level + 1)) {
+                pos = begin;
+                out.resize(mark);
+                return false;
+            }
+
+            // left hand side, operator and right hand side become one node, which is the left hand side of the next operator
+            add_node("op_expression", false, begin, mark, out);
+        }
+        return true;
+    }
+
+    bool atom(node_list& out) {
+        return memoized(atom_memo, out, [&](node_list& result) {
+            return rule("atom", false, result, [&](node_list& c) {
+                unary_operator(c);
+                return group(c, [&]() { return access_expression(c) && constructor_expression(c); }) ||
+                       group(c, [&]() { return parens_open(c) && expression(c) && parens_close(c); }) ||
+                       index_expression(c) ||
+                       list_expression(c) ||
+                       call_expression(c) ||
+                       group(c, [&]() { return parens_open(c) && operand(c) && parens_close(c); }) ||
+                       operand(c);
+            });
+        });
+    }
+
+    bool operand(node_list& out) {
+        std::size_t const mark = out.size();
+        return boundary_rule("operand", out, [&]() {
+            // only the token itself is kept
+            bool const matched = literal_(out) || identifier(out);
+            out.resize(mark);
+            return matched;
+        });
+    }
+
+    bool call_expression(node_list& out) {
+        return memoized(call_expression_memo, out, [&](node_list& result) {
+            return rule("call_expression", false, result, [&](node_list& c) {
+                namespace_list(c);
+                if (!identifier(c) && !builtin_function(c)) return false;
+                if (!space(c) || !parens_open(c)) return false;
+                argument_list(c);
+                return parens_close(c);
+            });
+        });
+    }
+
+    bool argument_list(node_list& out) {
+        return rule("argument_list", true, out, [&](node_list& c) {
+            if (!argument(c)) return false;
+            zero_or_more([&]() { return group(c, [&]() { return comma(c) && argument(c); }); });
+            return true;
+        });
+    }
+
+    bool argument(node_list& out) {
+        return rule("argument", false, out, [&](node_list& c) {
+            return rule("variadic_expansion", true, c, [&](node_list& v) { return identifier(v) && literal("..."); }) || expression(c);
+        });
+    }
+
+    bool index_expression(node_list& out) {
+        return memoized(index_expression_memo, out, [&](node_list& result) {
+            return rule("index_expression", false, result, [&](node_list& c) {
+                return identifier(c) && list_open(c) && expression(c) && list_close(c);
+            });
+        });
+    }
+
+    bool access_expression(node_list& out) {
+        return memoized(access_expression_memo, out, [&](node_list& result) {
+            return rule("access_expression", false, result, [&](node_list& c) {
+                bool const accessed = one_or_more([&]() {
+                    return group(c, [&]() { return (index_expression(c) || identifier(c)) && arrow(c); });
+                });
+                return accessed && (index_expression(c) || identifier(c)) && space(c);
+            });
+        });
+    }
+
+    // ================= control sequences =================
+
+    bool if_(node_list& out) {
+        return rule("if", false, out, [&](node_list& c) {
+            if (!literal("if") || !parens_open(c) || !expression(c) || !parens_close(c) || !compound(c)) return false;
+            rule("else", true, c, [&](node_list& e) { return literal("else") && compound(e); });
+            return true;
+        });
+    }
+
+    bool while_(node_list& out) {
+        return rule("while", false, out, [&](node_list& c) {
+            return literal("while") && parens_open(c) && expression(c) && parens_close(c) && compound(c);
+        });
+    }
+
+    bool for_(node_list& out) {
+        return rule("for", false, out, [&](node_list& c) {
+            return literal("for") && parens_open(c) && for_content(c) && parens_close(c) && compound(c);
+        });
+    }
+
+    bool for_content(node_list& out) {
+        return rule("for_content", false, out, [&](node_list& c) { return for_manual(c) || for_each(c); });
+    }
+
+    bool for_manual(node_list& out) {
+        return rule("for_manual", false, out, [&](node_list& c) {
+            return declaration(c) && semicolon(c) && expression(c) && semicolon(c) && expression(c);
+        });
+    }
+
+    bool for_each(node_list& out) {
+        return rule("for_each", false, out, [&](node_list& c) {
+            if (!literal("let ") || !identifier(c) || !space(c) || !colon(c) || !space(c)) return false;
+            return rule("range_expression", false, c, [&](node_list& r) {
+                return expression(r) && literal("..") && expression(r);
+            }) || expression(c);
+        });
+    }
+
+    // ================= comment =================
+
+    bool comment(node_list& out) {
+        return rule("comment", false, out, [&](node_list& c) { return literal("//") && any(c) && literal("\n"); });
+    }
+};
+
+ps::syntax_tree parse_native(std::string_view source, ps::packrat_mode packrat, ps::parse_stats* stats) {
+    native_parser parser { source, packrat };
+    return parser.parse(stats);
+}
+
+}
+
+#pragma clang diagnostic pop
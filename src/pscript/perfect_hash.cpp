@@ -0,0 +1,115 @@
+#include <pscript/perfect_hash.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <stdexcept>
+
+namespace ps {
+
+namespace {
+
+// splitmix64 finalizer, spreads all bits of the string hash before masking off the low bits.
+std::uint64_t mix(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+std::uint64_t hash_key(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+}
+
+std::size_t bucket_of(std::uint64_t hash, std::size_t bucket_count) {
+    return mix(hash) & (bucket_count - 1);
+}
+
+std::size_t slot_of(std::uint64_t hash, std::uint32_t seed, std::size_t slot_count) {
+    return mix(hash + (seed + 1) * 0x9e3779b97f4a7c15ull) & (slot_count - 1);
+}
+
+// Seeds that are tried for a bucket before giving up. With at most half of the slots used, a bucket is placed after a few tries.
+constexpr std::uint32_t max_seed = 1 << 20;
+
+}
+
+perfect_hash::perfect_hash(std::vector<std::string> keys) : keys(std::move(keys)) {
+    std::size_t const count = this->keys.size();
+    if (count == 0) return;
+
+    std::size_t const bucket_count = std::bit_ceil(count);
+    std::size_t const slot_count = std::bit_ceil(count * 2);
+    seeds.assign(bucket_count, 0);
+    slots.assign(slot_count, 0);
+
+    std::vector<std::uint64_t> hashes(count);
+    std::vector<std::vector<std::uint32_t>> buckets(bucket_count);
+    for (std::size_t i = 0; i < count; ++i) {
+        hashes[i] = hash_key(this->keys[i]);
+        buckets[bucket_of(hashes[i], bucket_count)].push_back(static_cast<std::uint32_t>(i));
+    }
+
+    // Place the largest buckets first, while most slots are still free.
+    std::vector<std::uint32_t> order(bucket_count);
+    for (std::size_t i = 0; i < bucket_count; ++i) order[i] = static_cast<std::uint32_t>(i);
+    std::stable_sort(order.begin(), order.end(), [&buckets](std::uint32_t lhs, std::uint32_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+
+    std::vector<std::size_t> placed {};
+    for (std::uint32_t bucket : order) {
+        auto const& members = buckets[bucket];
+        if (members.empty()) break;
+
+        std::uint32_t seed = 0;
+        for (; seed < max_seed; ++seed) {
+            placed.clear();
+            bool fits = true;
+            for (std::uint32_t key : members) {
+                std::size_t const slot = slot_of(hashes[key], seed, slot_count);
+                if (slots[slot] != 0 || std::find(placed.begin(), placed.end(), slot) != placed.end()) {
+                    fits = false;
+                    break;
+                }
+                placed.push_back(slot);
+            }
+            if (fits) break;
+        }
+
+        if (seed == max_seed) {
+            // only keys with the same hash never fit, check whether they are actually the same key.
+            for (std::uint32_t key : members) {
+                for (std::uint32_t other : members) {
+                    if (key != other && this->keys[key] == this->keys[other]) {
+                        throw std::runtime_error("Duplicate key '" + this->keys[key] + "' in perfect hash table.");
+                    }
+                }
+            }
+            throw std::runtime_error("Could not build perfect hash table.");
+        }
+
+        seeds[bucket] = seed;
+        for (std::size_t i = 0; i < members.size(); ++i) {
+            slots[placed[i]] = members[i] + 1;
+        }
+    }
+}
+
+std::size_t perfect_hash::find(std::string_view key) const noexcept {
+    if (keys.empty()) return npos;
+
+    std::uint64_t const hash = hash_key(key);
+    std::uint32_t const seed = seeds[bucket_of(hash, seeds.size())];
+    std::uint32_t const index = slots[slot_of(hash, seed, slots.size())];
+    if (index == 0 || keys[index - 1] != key) return npos;
+    return index - 1;
+}
+
+std::size_t perfect_hash::size() const noexcept {
+    return keys.size();
+}
+
+}
@@ -0,0 +1,121 @@
+#include <pscript/repl.hpp>
+
+#include <cctype>
+
+namespace ps {
+
+repl::repl(ps::context& ctx, ps::execution_context exec) : ctx(ctx), exec(std::move(exec)) {
+
+}
+
+// Checks if text starts with a keyword that is not part of a longer identifier, ignoring leading whitespace.
+static bool starts_with_keyword(std::string_view text, std::string_view keyword) {
+    std::size_t const start = text.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) return false;
+    text.remove_prefix(start);
+    if (!text.starts_with(keyword)) return false;
+    if (text.size() == keyword.size()) return true;
+    char const next = text[keyword.size()];
+    return !std::isalnum(static_cast<unsigned char>(next)) && next != '_';
+}
+
+bool repl::feed(std::string_view line) {
+    bool executed = false;
+    // a complete if statement is only executed once the next line shows it is not continued with an else.
+    if (awaiting_else) {
+        awaiting_else = false;
+        if (!starts_with_keyword(line, "else")) {
+            execute_buffer();
+            executed = true;
+        }
+    }
+
+    // ignore empty lines between chunks
+    if (buffer.empty() && line.find_first_not_of(" \t\r") == std::string_view::npos) return executed;
+
+    buffer += line;
+    buffer += '\n';
+    std::size_t last_statement = 0;
+    if (!is_complete(last_statement)) return executed;
+
+    // an if statement, or the else if branch of one, can still get another else branch
+    std::string_view statement = std::string_view { buffer }.substr(last_statement);
+    if (starts_with_keyword(statement, "else")) statement.remove_prefix(statement.find("else") + 4);
+    if (starts_with_keyword(statement, "if")) {
+        awaiting_else = true;
+        return executed;
+    }
+
+    execute_buffer();
+    return true;
+}
+
+bool repl::flush() {
+    if (!awaiting_else) return false;
+    awaiting_else = false;
+    execute_buffer();
+    return true;
+}
+
+void repl::execute_buffer() {
+    std::shared_ptr<ps::script> script = parsed[buffer].lock();
+    if (!script) {
+        script = std::make_shared<ps::script>(buffer, ctx);
+        parsed[buffer] = script;
+    }
+    buffer.clear();
+    ctx.execute(script, exec);
+    script.reset();
+
+    std::erase_if(parsed, [](auto const& entry) { return entry.second.expired(); });
+}
+
+bool repl::pending() const noexcept {
+    return !buffer.empty();
+}
+
+void repl::clear() noexcept {
+    buffer.clear();
+    awaiting_else = false;
+}
+
+std::size_t repl::parsed_chunks() const noexcept {
+    return parsed.size();
+}
+
+bool repl::is_complete(std::size_t& last_statement) const noexcept {
+    int depth = 0;
+    bool in_string = false;
+    char last = '\0';
+    // start of the statement after the most recent top level ';' or '}'
+    std::size_t statement_start = 0;
+    last_statement = 0;
+    for (std::size_t i = 0; i < buffer.size(); ++i) {
+        char const c = buffer[i];
+        if (in_string) {
+            if (c == '"') in_string = false;
+            continue;
+        }
+        // comments run until the end of the line
+        if (c == '/' && i + 1 < buffer.size() && buffer[i + 1] == '/') {
+            i = buffer.find('\n', i);
+            if (i == std::string::npos) break;
+            continue;
+        }
+
+        if (c == '"') in_string = true;
+        else if (c == '(' || c == '{' || c == '[') ++depth;
+        else if (c == ')' || c == '}' || c == ']') --depth;
+
+        if (depth == 0 && (c == ';' || c == '}')) {
+            last_statement = statement_start;
+            statement_start = i + 1;
+        }
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n') last = c;
+    }
+    // unbalanced closing brackets can never be completed, execute them to report the error.
+    if (depth < 0) return true;
+    return !in_string && depth == 0 && (last == ';' || last == '}');
+}
+
+}
@@ -1,27 +1,347 @@
 #include <pscript/script.hpp>
 
 #include <pscript/context.hpp>
+#include <pscript/parser.hpp>
 #include <peglib.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cctype>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
 namespace ps {
 
+using namespace peg::udl;
+
+static bool node_is_type(ps::ast_node const& node, unsigned int type) {
+    return node.tag == type || node.original_tag == type;
+}
+
+static ps::symbol child_symbol(ps::ast_node const& node, unsigned int type) {
+    for (auto const& child : node.nodes()) {
+        if (node_is_type(child, type)) return child.sym;
+    }
+    return ps::null_symbol;
+}
+
+// Prefixes a name with the namespace stored in the namespace_list child of a node, if there is one.
+static ps::symbol qualify(ps::ast_node const& node, ps::symbol name) {
+    ps::symbol const ns = child_symbol(node, "namespace_list"_);
+    if (ns == ps::null_symbol || name == ps::null_symbol) return name;
+    return ps::intern(symbol_name(ns) + '.' + symbol_name(name));
+}
+
+// Copies the optimized AST created by peglib into a syntax tree, in breadth first order.
+// The amount of nodes in peglib's tree is stored in node_count.
+static ps::syntax_tree flatten(peg::Ast const& root, std::size_t& node_count) {
+    ps::syntax_tree tree {};
+    std::vector<std::pair<peg::Ast const*, std::uint32_t>> queue { { &root, tree.add_root() } };
+    for (std::size_t i = 0; i < queue.size(); ++i) {
+        auto const [ast, index] = queue[i];
+        ps::ast_node& node = tree.node(index);
+        node.tag = ast->tag;
+        node.original_tag = ast->original_tag;
+        node.line = static_cast<std::uint32_t>(ast->line);
+        node.column = static_cast<std::uint32_t>(ast->column);
+        node.is_token = ast->is_token;
+        node.token = ast->token;
+
+        if (ast->nodes.empty()) continue;
+        auto const count = static_cast<std::uint32_t>(ast->nodes.size());
+        std::uint32_t const first = tree.add_children(index, count);
+        for (std::uint32_t child = 0; child < count; ++child) {
+            queue.emplace_back(ast->nodes[child].get(), first + child);
+        }
+    }
+    node_count = queue.size();
+    return tree;
+}
+
+// Interns all names in the tree, so they never have to be hashed again during execution.
+// String literals are stored once per script.
+static void resolve_symbols(ps::syntax_tree& tree) {
+    std::unordered_map<std::string_view, std::shared_ptr<std::string const> const*> literals {};
+    // children are stored after their parent, so going backwards visits all children before their parent.
+    for (auto i = static_cast<std::uint32_t>(tree.nodes().size()); i-- > 0;) {
+        ps::ast_node& node = tree.node(i);
+        if (node_is_type(node, "identifier"_)) {
+            node.sym = ps::intern(node.token);
+        } else if (node_is_type(node, "operand"_)) {
+            // Only identifiers get a symbol, literals are recognized by a null symbol.
+            bool const is_identifier = !node.token.empty() && std::isalpha(static_cast<unsigned char>(node.token[0]));
+            if (is_identifier && node.token != "true" && node.token != "false") {
+                node.sym = ps::intern(node.token);
+            } else if (node.token.size() >= 2 && node.token[0] == '"') {
+                std::string_view const contents = node.token.substr(1, node.token.size() - 2);
+                auto& literal = literals[contents];
+                if (!literal) literal = tree.add_literal(std::make_shared<std::string const>(contents));
+                node.literal = literal;
+            }
+        } else if (node_is_type(node, "namespace_list"_)) {
+            std::string ns;
+            for (auto const& child : node.nodes()) {
+                if (node_is_type(child, "namespace"_)) {
+                    if (!ns.empty()) ns += '.';
+                    ns += symbol_name(child.sym);
+                }
+            }
+            node.sym = ps::intern(ns);
+        } else if (node_is_type(node, "call_expression"_) || node_is_type(node, "typename"_)) {
+            node.sym = qualify(node, child_symbol(node, "identifier"_));
+        }
+    }
+}
+
+static void collect_imports(ps::ast_node const& node, std::vector<std::string>& imports) {
+    if (node_is_type(node, "import"_)) {
+        std::string name;
+        for (auto const& child : node.nodes()) {
+            if (node_is_type(child, "module_folder"_) || node_is_type(child, "module_name"_)) {
+                if (!name.empty()) name += '.';
+                name += child.token;
+            }
+        }
+        imports.push_back(std::move(name));
+        return;
+    }
+
+    for (auto const& child : node.nodes()) {
+        collect_imports(child, imports);
+    }
+}
+
+script::script(std::string source, ps::context& ctx) : original_source(std::move(source)), source_text(original_source) {
+    parse(ctx);
+}
+
+script::script(ps::mapped_file source, ps::context& ctx) : file(std::move(source)), source_text(file.contents()) {
+    parse(ctx);
+}
+
+void script::parse(ps::context& ctx) {
+    auto const start = std::chrono::steady_clock::now();
 
-script::script(std::string source, ps::context& ctx) : original_source(std::move(source)) {
     // Parse script into its AST.
-    peg::parser const& parser = ctx.parser();
-    parser.parse(original_source, peg_ast);
-    if (peg_ast) {
-        peg_ast = parser.optimize_ast(peg_ast);
+    if (ctx.backend() == ps::parser_backend::native) {
+        syntax = ps::parse_native(source_text, ctx.packrat(), &statistics);
+    } else {
+        std::shared_ptr<peg::Ast> peg_ast = nullptr;
+        statistics.packrat = ctx.use_packrat(source_text.size());
+        // peglib's precedence climbing temporarily replaces the action of the operator rule while parsing. Every thread has its own
+        // parser, so scripts on different threads are still parsed in parallel.
+        peg::parser const& parser = ctx.parser(statistics.packrat);
+        parser.parse(source_text, peg_ast);
+        if (peg_ast) peg_ast = parser.optimize_ast(peg_ast);
+        // peglib's tree is only used to build the syntax tree, and freed right after.
+        std::size_t peg_nodes = 0;
+        if (peg_ast) syntax = flatten(*peg_ast, peg_nodes);
+
+        // peglib keeps two bits for every rule and position. The results it stored cannot be counted, so they are not included.
+        if (statistics.packrat) statistics.memo_entries = ps::context::grammar_rules() * (source_text.size() + 1);
+        statistics.peak_bytes = statistics.memo_entries / 4 + peg_nodes * sizeof(peg::Ast) + syntax.memory_usage();
+    }
+
+    if (syntax.root()) {
+        resolve_symbols(syntax);
+        collect_imports(*syntax.root(), imported_modules);
     }
+
+    statistics.time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
 }
 
-std::string const& script::source() const {
-    return original_source;
+// Precompiled format. All integers are unsigned 32 bit little endian, strings are a length followed by the characters.
+//  header:   magic "PSCB", version
+//  source:   string
+//  tables:   symbol names and string literals, each a count followed by that many strings
+//  ast:      node count (0 if the script has a syntax error), followed by the nodes of the syntax tree in order
+//  node:     tag, original tag, first child offset, child count, line, column, is_token, token offset and size into the source,
+//            symbol + 1 (0 if none), literal + 1 (0 if none)
+static constexpr std::array<char, 4> binary_magic = { 'P', 'S', 'C', 'B' };
+
+static void write_u32(std::ostream& out, std::uint32_t value) {
+    std::array<char, 4> bytes {};
+    for (std::size_t i = 0; i < bytes.size(); ++i) {
+        bytes[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+    out.write(bytes.data(), bytes.size());
 }
 
-std::shared_ptr<ps::Ast> const& script::ast() const {
-    return peg_ast;
+static void write_string(std::ostream& out, std::string_view str) {
+    write_u32(out, static_cast<std::uint32_t>(str.size()));
+    out.write(str.data(), static_cast<std::streamsize>(str.size()));
 }
 
+// Reads from a buffer holding an entire precompiled script.
+struct binary_reader {
+    std::string_view data {};
+    std::size_t offset = 0;
+
+    std::uint32_t u32() {
+        std::string_view const bytes = take(4);
+        std::uint32_t value = 0;
+        for (std::size_t i = 0; i < bytes.size(); ++i) {
+            value |= static_cast<std::uint32_t>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+        }
+        return value;
+    }
+
+    std::string_view string() {
+        return take(u32());
+    }
+
+    std::string_view take(std::size_t size) {
+        if (size > data.size() - offset) throw std::runtime_error("invalid precompiled script: unexpected end of data");
+        std::string_view const result = data.substr(offset, size);
+        offset += size;
+        return result;
+    }
+};
 
-}
\ No newline at end of file
+template<typename T>
+static T const& table_entry(std::vector<T> const& table, std::uint32_t index) {
+    if (index >= table.size()) throw std::runtime_error("invalid precompiled script: table index out of range");
+    return table[index];
+}
+
+script::script(std::istream& in) {
+    std::string const data { std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+    binary_reader reader { data };
+
+    std::string_view const magic = reader.take(binary_magic.size());
+    if (!std::equal(binary_magic.begin(), binary_magic.end(), magic.begin())) {
+        throw std::runtime_error("invalid precompiled script: wrong file type");
+    }
+    std::uint32_t const version = reader.u32();
+    if (version != binary_version) {
+        throw std::runtime_error("invalid precompiled script: version " + std::to_string(version) +
+                                 " is not supported, expected version " + std::to_string(binary_version));
+    }
+
+    original_source = reader.string();
+    source_text = original_source;
+    std::string_view const source = source_text;
+
+    std::vector<ps::symbol> symbols(reader.u32());
+    for (auto& sym : symbols) {
+        sym = ps::intern(reader.string());
+    }
+    std::vector<std::shared_ptr<std::string const> const*> literals(reader.u32());
+    for (auto& literal : literals) {
+        literal = syntax.add_literal(std::make_shared<std::string const>(reader.string()));
+    }
+
+    std::uint32_t const node_count = reader.u32();
+    // every node takes 11 integers, check this before allocating the nodes
+    if (node_count > (data.size() - reader.offset) / 44) throw std::runtime_error("invalid precompiled script: unexpected end of data");
+    if (node_count == 0) return;
+    syntax.add_nodes(node_count);
+    for (std::uint32_t i = 0; i < node_count; ++i) {
+        ps::ast_node& node = syntax.node(i);
+        node.tag = reader.u32();
+        node.original_tag = reader.u32();
+        node.first_child = reader.u32();
+        node.child_count = reader.u32();
+        // children must come after their parent, so the tree can never contain cycles
+        if (node.child_count != 0 && (node.first_child == 0 || node.first_child > node_count - i ||
+                                      node.child_count > node_count - i - node.first_child)) {
+            throw std::runtime_error("invalid precompiled script: child index out of range");
+        }
+        node.line = reader.u32();
+        node.column = reader.u32();
+        node.is_token = reader.u32() != 0;
+        std::uint32_t const token_offset = reader.u32();
+        std::uint32_t const token_size = reader.u32();
+        if (token_offset > source.size() || token_size > source.size() - token_offset) {
+            throw std::runtime_error("invalid precompiled script: token outside of script source");
+        }
+        if (node.is_token) node.token = source.substr(token_offset, token_size);
+        std::uint32_t const sym = reader.u32();
+        if (sym != 0) node.sym = table_entry(symbols, sym - 1);
+        std::uint32_t const literal = reader.u32();
+        if (literal != 0) node.literal = table_entry(literals, literal - 1);
+    }
+
+    collect_imports(*syntax.root(), imported_modules);
+}
+
+void script::save(std::ostream& out) const {
+    // Assign every distinct symbol and literal an index, in order of first appearance.
+    std::vector<ps::symbol> symbols {};
+    std::unordered_map<ps::symbol, std::uint32_t> symbol_index {};
+    for (ps::ast_node const& node : syntax.nodes()) {
+        if (node.sym != ps::null_symbol && symbol_index.insert({ node.sym, symbols.size() }).second) {
+            symbols.push_back(node.sym);
+        }
+    }
+    std::unordered_map<std::shared_ptr<std::string const> const*, std::uint32_t> literal_index {};
+    for (auto const& literal : syntax.literals()) {
+        literal_index.insert({ &literal, literal_index.size() });
+    }
+
+    out.write(binary_magic.data(), binary_magic.size());
+    write_u32(out, binary_version);
+    write_string(out, source_text);
+
+    write_u32(out, static_cast<std::uint32_t>(symbols.size()));
+    for (ps::symbol sym : symbols) {
+        write_string(out, symbol_name(sym));
+    }
+    write_u32(out, static_cast<std::uint32_t>(syntax.literals().size()));
+    for (auto const& literal : syntax.literals()) {
+        write_string(out, *literal);
+    }
+
+    std::string_view const source = source_text;
+    write_u32(out, static_cast<std::uint32_t>(syntax.nodes().size()));
+    for (ps::ast_node const& node : syntax.nodes()) {
+        write_u32(out, node.tag);
+        write_u32(out, node.original_tag);
+        write_u32(out, node.first_child);
+        write_u32(out, node.child_count);
+        write_u32(out, node.line);
+        write_u32(out, node.column);
+        write_u32(out, node.is_token);
+        if (node.is_token) {
+            // tokens always point into the source they were parsed from
+            if (node.token.data() < source.data() || node.token.data() + node.token.size() > source.data() + source.size()) {
+                throw std::runtime_error("cannot save script: token outside of script source");
+            }
+            write_u32(out, static_cast<std::uint32_t>(node.token.data() - source.data()));
+            write_u32(out, static_cast<std::uint32_t>(node.token.size()));
+        } else {
+            write_u32(out, 0);
+            write_u32(out, 0);
+        }
+        write_u32(out, node.sym == ps::null_symbol ? 0 : symbol_index.at(node.sym) + 1);
+        write_u32(out, node.literal ? literal_index.at(node.literal) + 1 : 0);
+    }
+}
+
+std::string_view script::source() const {
+    return source_text;
+}
+
+ps::ast_node const* script::ast() const {
+    return syntax.root();
+}
+
+ps::syntax_tree const& script::tree() const {
+    return syntax;
+}
+
+std::vector<std::string> const& script::imports() const {
+    return imported_modules;
+}
+
+ps::parse_stats const& script::stats() const {
+    return statistics;
+}
+
+
+}
@@ -0,0 +1,57 @@
+#include <pscript/symbol.hpp>
+
+#include <mutex>
+
+namespace ps {
+
+symbol_table::symbol_table() {
+    // Order must match the constants in ps::symbols. The empty name takes id 0 so it maps to null_symbol.
+    for (std::string_view name : { "", "ref", "print", "readln", "time", "dump", "append", "size", "format", "parse_int", "parse_float" }) {
+        [[maybe_unused]] ps::symbol _ = intern(name);
+    }
+}
+
+symbol_table& symbol_table::global() {
+    static symbol_table table {};
+    return table;
+}
+
+ps::symbol symbol_table::intern(std::string_view name) {
+    {
+        std::shared_lock lock { mutex };
+        auto it = lookup.find(name);
+        if (it != lookup.end()) return it->second;
+    }
+
+    std::unique_lock lock { mutex };
+    // Another thread may have interned the same name in the meantime.
+    auto it = lookup.find(name);
+    if (it != lookup.end()) return it->second;
+
+    auto const sym = static_cast<ps::symbol>(names.size());
+    names.emplace_back(name);
+    lookup.insert({ names.back(), sym });
+    return sym;
+}
+
+ps::symbol symbol_table::find(std::string_view name) const {
+    std::shared_lock lock { mutex };
+    auto it = lookup.find(name);
+    if (it != lookup.end()) return it->second;
+    return ps::null_symbol;
+}
+
+std::string const& symbol_table::name(ps::symbol sym) const {
+    std::shared_lock lock { mutex };
+    return names.at(sym);
+}
+
+ps::symbol intern(std::string_view name) {
+    return symbol_table::global().intern(name);
+}
+
+std::string const& symbol_name(ps::symbol sym) {
+    return symbol_table::global().name(sym);
+}
+
+}
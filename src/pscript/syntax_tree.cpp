@@ -0,0 +1,59 @@
+#include <pscript/syntax_tree.hpp>
+
+#include <stdexcept>
+
+namespace ps {
+
+ps::ast_node const* syntax_tree::root() const noexcept {
+    if (node_storage.empty()) return nullptr;
+    return &node_storage.front();
+}
+
+std::span<ps::ast_node const> syntax_tree::nodes() const noexcept {
+    return node_storage;
+}
+
+std::deque<std::shared_ptr<std::string const>> const& syntax_tree::literals() const noexcept {
+    return literal_storage;
+}
+
+std::size_t syntax_tree::memory_usage() const noexcept {
+    std::size_t bytes = node_storage.capacity() * sizeof(ps::ast_node);
+    for (auto const& literal : literal_storage) {
+        bytes += sizeof(literal) + sizeof(std::string) + literal->capacity();
+    }
+    return bytes;
+}
+
+std::uint32_t syntax_tree::add_root() {
+    if (!node_storage.empty()) throw std::logic_error("syntax tree already has a root node");
+    node_storage.emplace_back();
+    return 0;
+}
+
+std::uint32_t syntax_tree::add_children(std::uint32_t parent, std::uint32_t count) {
+    std::uint32_t const first = add_nodes(count);
+    node_storage[parent].first_child = first - parent;
+    node_storage[parent].child_count = count;
+    return first;
+}
+
+std::uint32_t syntax_tree::add_nodes(std::uint32_t count) {
+    auto const first = static_cast<std::uint32_t>(node_storage.size());
+    node_storage.resize(node_storage.size() + count);
+    return first;
+}
+
+ps::ast_node& syntax_tree::node(std::uint32_t index) noexcept {
+    return node_storage[index];
+}
+
+std::shared_ptr<std::string const> const* syntax_tree::add_literal(std::shared_ptr<std::string const> literal) {
+    return &literal_storage.emplace_back(std::move(literal));
+}
+
+void syntax_tree::reserve(std::size_t count) {
+    node_storage.reserve(count);
+}
+
+}
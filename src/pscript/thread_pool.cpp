@@ -0,0 +1,92 @@
+#include <pscript/thread_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+
+namespace ps {
+
+struct thread_pool::job {
+    job(std::function<void(std::size_t)> const& f, std::size_t count) : f(f), count(count) {}
+
+    std::function<void(std::size_t)> const& f;
+    std::size_t const count;
+    std::atomic<std::size_t> next = 0;
+    // iterations that finished, protected by the mutex of the pool
+    std::size_t done = 0;
+};
+
+thread_pool::thread_pool(std::size_t threads) : thread_count(std::max<std::size_t>(threads, 1)) {
+
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock { mutex };
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void thread_pool::parallel_for(std::size_t count, std::function<void(std::size_t)> const& f) {
+    if (count <= 1 || thread_count <= 1) {
+        for (std::size_t i = 0; i < count; ++i) f(i);
+        return;
+    }
+
+    auto const current = std::make_shared<job>(f, count);
+    {
+        std::lock_guard lock { mutex };
+        if (workers.empty()) {
+            workers.reserve(thread_count - 1);
+            for (std::size_t i = 1; i < thread_count; ++i) {
+                workers.emplace_back(&thread_pool::work, this);
+            }
+        }
+        jobs.push_back(current);
+    }
+    work_available.notify_all();
+
+    std::size_t const finished = run(*current);
+
+    std::unique_lock lock { mutex };
+    auto const it = std::find(jobs.begin(), jobs.end(), current);
+    if (it != jobs.end()) jobs.erase(it);
+    current->done += finished;
+    job_done.wait(lock, [&current] { return current->done == current->count; });
+}
+
+std::size_t thread_pool::size() const noexcept {
+    return thread_count;
+}
+
+void thread_pool::work() {
+    std::unique_lock lock { mutex };
+    while (true) {
+        work_available.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) return;
+
+        std::shared_ptr<job> const current = jobs.front();
+        lock.unlock();
+        std::size_t const finished = run(*current);
+        lock.lock();
+
+        // no iterations are left to start, so other workers should not pick this job anymore
+        if (!jobs.empty() && jobs.front() == current) jobs.pop_front();
+        current->done += finished;
+        if (current->done == current->count) job_done.notify_all();
+    }
+}
+
+std::size_t thread_pool::run(job& j) {
+    std::size_t finished = 0;
+    for (std::size_t i = j.next++; i < j.count; i = j.next++) {
+        j.f(i);
+        ++finished;
+    }
+    return finished;
+}
+
+}
@@ -1,5 +1,6 @@
 #include <pscript/value.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -81,6 +82,14 @@ size_t list_type::size() const {
     return storage.size();
 }
 
+list_type list_type::clone(ps::clone_map& copies) const {
+    list_type result = *this;
+    for (auto& element : result.storage) {
+        element = element.clone(copies);
+    }
+    return result;
+}
+
 std::string list_type::to_string() const {
     std::ostringstream out {};
     out << '[';
@@ -97,7 +106,58 @@ std::ostream& operator<<(std::ostream& out, list_type const& list) {
 }
 
 string_type::string_type(std::string const& str) {
-    storage = str;
+    assign(str);
+}
+
+string_type::string_type(std::shared_ptr<std::string const> literal) {
+    if (literal->size() <= small_capacity) {
+        // copying a few bytes is cheaper than touching the shared reference count every time this string is copied.
+        assign(*literal);
+    } else {
+        storage = shared_storage { std::move(literal) };
+    }
+}
+
+void string_type::assign(std::string_view str) {
+    if (str.size() <= small_capacity) {
+        small_storage small {};
+        std::copy(str.begin(), str.end(), small.data.begin());
+        small.size = static_cast<std::uint8_t>(str.size());
+        storage = small;
+    } else {
+        storage = shared_storage { std::make_shared<std::string const>(str) };
+    }
+}
+
+void string_type::append(std::string_view str) {
+    if (str.empty()) return;
+    std::string result {};
+    result.reserve(size() + str.size());
+    result += representation();
+    result += str;
+    assign(result);
+}
+
+std::string_view string_type::representation() const {
+    if (auto const* small = std::get_if<small_storage>(&storage)) {
+        return { small->data.data(), small->size };
+    }
+    auto const& shared = std::get<shared_storage>(storage);
+    if (!shared.data) return {};
+    return *shared.data;
+}
+
+char const* string_type::c_str() const {
+    if (auto const* small = std::get_if<small_storage>(&storage)) {
+        return small->data.data();
+    }
+    auto const& shared = std::get<shared_storage>(storage);
+    if (!shared.data) return "";
+    return shared.data->c_str();
+}
+
+std::size_t string_type::size() const {
+    return representation().size();
 }
 
 using arg_store = fmt::dynamic_format_arg_store<fmt::format_context>;
@@ -141,49 +201,69 @@ static std::string format_vector(std::string_view format, std::vector<ps::value>
 
 
 string_type string_type::format(std::vector<ps::value> const& args) const {
-    return ps::string_type { format_vector(storage, args) };
+    return ps::string_type { format_vector(representation(), args) };
 }
 
 int string_type::parse_int() const {
-    return std::stoi(storage);
+    return std::stoi(std::string { representation() });
 }
 
 float string_type::parse_float() const {
-    return std::stof(storage);
+    return std::stof(std::string { representation() });
 }
 
 std::ostream& operator<<(std::ostream& out, string_type const& str) {
-    return out << str.storage;
+    return out << str.representation();
 }
 
-struct_type::struct_type(std::string const& name, std::unordered_map<std::string, ps::value> const& initializers) {
+struct_type::struct_type(ps::symbol name, std::unordered_map<ps::symbol, ps::value> const& initializers) {
     this->name = name;
     members = initializers;
 }
 
 std::string struct_type::to_string() const {
     std::ostringstream oss {};
-    oss << name;
+    oss << symbol_name(name);
     oss << " {\n";
-    for (auto const& [field_name, value] : members) {
-        oss << '\t' << field_name << ": " << value << '\n';
+    for (auto const& [field, value] : members) {
+        oss << '\t' << symbol_name(field) << ": " << value << '\n';
     }
     oss << "}";
     return oss.str();
 }
 
 ps::value& struct_type::access(std::string const& field_name) {
-    return members.at(field_name);
+    return members.at(symbol_table::global().find(field_name));
 }
 
 ps::value const& struct_type::access(std::string const& field_name) const {
-    return members.at(field_name);
+    return members.at(symbol_table::global().find(field_name));
+}
+
+ps::value& struct_type::access(ps::symbol field) {
+    return members.at(field);
+}
+
+ps::value const& struct_type::access(ps::symbol field) const {
+    return members.at(field);
 }
 
 [[nodiscard]] std::string const& struct_type::type_name() const {
+    return symbol_name(name);
+}
+
+[[nodiscard]] ps::symbol struct_type::type_symbol() const {
     return name;
 }
 
+struct_type struct_type::clone(ps::clone_map& copies) const {
+    struct_type result = *this;
+    for (auto& [field, value] : result.members) {
+        value = value.clone(copies);
+    }
+    return result;
+}
+
 std::ostream& operator<<(std::ostream& out, struct_type const& s) {
     return out << s.to_string();
 }
@@ -231,11 +311,25 @@ value& value::operator=(value const& rhs) {
             throw std::runtime_error("TypeError: Invalid cast from "s + type_str(rhs.tpe).data() + " to "s + type_str(tpe).data() + ".");
         }
 
+        // values in host memory keep their storage, the new value is written to it.
+        if (in_host_memory) {
+            visit_value(*this, [&rhs](auto& lhs_val) {
+                visit_value(rhs, [&lhs_val](auto const& rhs_val) {
+                    using lhs_type = std::remove_cvref_t<decltype(lhs_val.value())>;
+                    using rhs_type = std::remove_cvref_t<decltype(rhs_val.value())>;
+                    if constexpr (std::is_arithmetic_v<lhs_type> && std::is_arithmetic_v<rhs_type>) {
+                        lhs_val.value() = static_cast<lhs_type>(rhs_val.value());
+                    }
+                });
+            });
+            return *this;
+        }
+
         // do typecheck for struct types by comparing names
         if (tpe == ps::type::structure && rhs.tpe == ps::type::structure) {
             auto& lhs_struct = static_cast<ps::structure&>(*this);
             auto const& rhs_struct = static_cast<ps::structure const&>(rhs);
-            if (lhs_struct->type_name() != rhs_struct->type_name()) {
+            if (lhs_struct->type_symbol() != rhs_struct->type_symbol()) {
                 throw std::runtime_error("TypeError: Invalid cast from "s + lhs_struct->type_name() + " to "s + rhs_struct->type_name() + ".");
             }
         }
@@ -268,16 +362,23 @@ value::value(ps::value&& rhs) noexcept {
         memory = rhs.memory;
         refcount = rhs.refcount;
         is_ref = rhs.is_ref;
+        in_host_memory = rhs.in_host_memory;
         rhs.ptr = ps::null_pointer;
         rhs.tpe = {};
         rhs.memory = nullptr;
         rhs.refcount = nullptr;
         rhs.is_ref = false;
+        rhs.in_host_memory = false;
     }
 }
 
-ps::value& value::operator=(ps::value&& rhs) noexcept {
+ps::value& value::operator=(ps::value&& rhs) {
     if (&rhs != this) {
+        // compound assignments (+= and so on) move their result into the value, this must also write to host memory.
+        if (in_host_memory) {
+            return *this = static_cast<ps::value const&>(rhs);
+        }
+
         on_destroy();
 
         ptr = rhs.ptr;
@@ -285,16 +386,20 @@ ps::value& value::operator=(ps::value&& rhs) noexcept {
         memory = rhs.memory;
         refcount = rhs.refcount;
         is_ref = rhs.is_ref;
+        in_host_memory = rhs.in_host_memory;
         rhs.ptr = ps::null_pointer;
         rhs.tpe = {};
         rhs.memory = nullptr;
         rhs.refcount = nullptr;
         rhs.is_ref = false;
+        rhs.in_host_memory = false;
     }
     return *this;
 }
 
 void value::on_destroy() {
+    // host memory is owned by the host
+    if (in_host_memory) return;
     if (ptr != ps::null_pointer) {
         // call object destructor
         if (is_reference()) {
@@ -424,6 +529,19 @@ ps::value value::ref(ps::value const& rhs) {
     return val;
 }
 
+ps::value value::host(ps::memory_pool& memory, void* address, ps::type type) {
+    if (type != ps::type::integer && type != ps::type::uint && type != ps::type::real && type != ps::type::boolean) {
+        throw std::runtime_error("TypeError: Only int, uint, float and bool values can be stored in host memory.");
+    }
+    ps::value val {};
+    val.memory = &memory;
+    val.tpe = type;
+    // pointers are addresses, see memory_pool::decode_pointer()
+    val.ptr = reinterpret_cast<ps::pointer>(address);
+    val.in_host_memory = true;
+    return val;
+}
+
 ps::pointer value::pointer() const {
     return ptr;
 }
@@ -448,6 +566,32 @@ ps::real const& value::real_value() const {
     return memory->get<ps::real>(ptr);
 }
 
+ps::value value::clone() const {
+    ps::clone_map copies {};
+    return clone(copies);
+}
+
+ps::value value::clone(ps::clone_map& copies) const {
+    // the host owns this data, so a copy must still refer to it.
+    if (in_host_memory) return value::host(*memory, reinterpret_cast<void*>(ptr), tpe);
+    bool const shared = tpe == ps::type::list || tpe == ps::type::structure;
+    if (shared) {
+        // copying a value that stores a list or struct shares its data
+        auto it = copies.find(ptr);
+        if (it != copies.end()) return it->second;
+    }
+    ps::value result = value::null();
+    visit_value(*this, [this, &result, &copies]<typename T>(T const& val) {
+        result = value::from(*memory, val.value());
+        if constexpr (std::is_same_v<T, ps::list> || std::is_same_v<T, ps::structure>) {
+            // remembered before copying the elements, so a list or struct that contains itself is copied once too
+            copies.emplace(ptr, result);
+            static_cast<T&>(result).value() = val->clone(copies);
+        }
+    });
+    return result;
+}
+
 void value::cast_this(ps::type new_type) {
     if (!may_cast(new_type, tpe)) throw std::runtime_error("TypeError: Invalid cast_this() call");
     visit_type(new_type, [this]<typename T>() {
@@ -1,7 +1,19 @@
 #include <pscript/context.hpp>
+#include <pscript/context_pool.hpp>
+#include <pscript/execution.hpp>
+#include <pscript/extern_registry.hpp>
+#include <pscript/module_cache.hpp>
+#include <pscript/perfect_hash.hpp>
+#include <pscript/repl.hpp>
+#include <pscript/thread_pool.hpp>
 #include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <mutex>
 #include <fstream>
+#include <future>
+#include <thread>
+#include <unordered_set>
 
 #include <catch2/catch_test_macros.hpp>
 
@@ -27,9 +39,8 @@ void no_ret_type(int x) {
     std::cout << x << std::endl;
 }
 
-// external type must be integer
-int print_int(ps::external const& ext) {
-    std::cout << static_cast<int const&>(ext.value()) << std::endl;
+int print_int(int x) {
+    std::cout << x << std::endl;
     return 0;
 }
 
@@ -42,6 +53,17 @@ int print_ext_struct(ps::external const& ext) {
     return 0;
 }
 
+struct Point {
+    float x;
+    float y;
+};
+
+template<>
+struct ps::native_layout<Point> {
+    static constexpr std::string_view name = "Point";
+    static constexpr auto fields = std::tuple { ps::field("x", &Point::x), ps::field("y", &Point::y) };
+};
+
 void test_f([[maybe_unused]] int x) {
 
 }
@@ -59,6 +81,69 @@ TEST_CASE("create context") {
     } 
 }
 
+TEST_CASE("shared parser") {
+    ps::context a(512);
+    ps::context b(512);
+    CHECK(&a.parser() == &b.parser());
+
+    // peglib parsers cannot be used concurrently, so every thread has its own.
+    peg::parser const* other = nullptr;
+    std::thread thread { [&other, &a] { other = &a.parser(); } };
+    thread.join();
+    CHECK(other != &a.parser());
+
+    // a thread that exited leaves its parser to the next one, so contexts on fresh threads do not compile the grammar again.
+    for (int i = 0; i < 8; ++i) {
+        peg::parser const* reused = nullptr;
+        bool parsed = false;
+        std::thread fresh { [&reused, &parsed] {
+            ps::context ctx(512);
+            reused = &ctx.parser();
+            ps::script script("let x = 1 + 2;", ctx);
+            parsed = script.ast() != nullptr;
+        } };
+        fresh.join();
+        CHECK(reused == other);
+        CHECK(parsed);
+    }
+}
+
+TEST_CASE("parallel parsing") {
+    // contexts on different threads parse at the same time, with their own parser
+    std::atomic<int> parsed = 0;
+    std::vector<std::thread> threads {};
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&parsed] {
+            ps::context ctx(1024);
+            for (int j = 0; j < 8; ++j) {
+                ps::script script("let x = ((1 + 2) * 3) - f(4, 5);", ctx);
+                if (script.ast()) ++parsed;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    CHECK(parsed == 32);
+}
+
+TEST_CASE("thread pool") {
+    ps::thread_pool pool(4);
+    CHECK(pool.size() == 4);
+
+    // the same workers run every loop, and every iteration runs exactly once
+    std::mutex mutex {};
+    std::unordered_set<std::thread::id> threads {};
+    for (int loop = 0; loop < 16; ++loop) {
+        std::vector<int> counts(100, 0);
+        pool.parallel_for(counts.size(), [&](std::size_t i) {
+            ++counts[i];
+            std::lock_guard lock { mutex };
+            threads.insert(std::this_thread::get_id());
+        });
+        CHECK(std::all_of(counts.begin(), counts.end(), [](int count) { return count == 1; }));
+    }
+    CHECK(threads.size() <= 4);
+}
+
 TEST_CASE("pscript context", "[context]") {
     // create context with 1 MiB memory.
     constexpr std::size_t memsize = 1024 * 1024;
@@ -123,6 +208,16 @@ TEST_CASE("pscript context", "[context]") {
     }
 }
 
+TEST_CASE("symbols") {
+    ps::symbol a = ps::intern("some_name");
+    ps::symbol b = ps::intern(std::string("some_") + "name");
+    CHECK(a == b);
+    CHECK(a != ps::intern("other_name"));
+    CHECK(ps::symbol_name(a) == "some_name");
+    CHECK(ps::intern("print") == ps::symbols::print);
+    CHECK(ps::symbol_table::global().find("never_interned_name") == ps::null_symbol);
+}
+
 TEST_CASE("script expression parser", "[script]") {
     constexpr std::size_t memsize = 128;
     ps::context ctx(memsize);
@@ -482,6 +577,34 @@ TEST_CASE("strings") {
     }
 }
 
+TEST_CASE("string storage") {
+    constexpr std::size_t memsize = 1024;
+    ps::context ctx(memsize);
+
+    SECTION("literals outlive their script") {
+        {
+            ps::script script(R"(
+                let short_str = "abc";
+                let long_str = "this literal is too long to be stored inline";
+            )", ctx);
+            ctx.execute(script);
+        }
+
+        auto const& short_str = static_cast<ps::str const&>(ctx.get_variable_value("short_str"));
+        auto const& long_str = static_cast<ps::str const&>(ctx.get_variable_value("long_str"));
+        CHECK(short_str->representation() == "abc");
+        CHECK(std::string(long_str->c_str()) == "this literal is too long to be stored inline");
+    }
+
+    SECTION("copy on write") {
+        ps::string_type original { std::string(32, 'a') };
+        ps::string_type copy = original;
+        copy.append("b");
+        CHECK(original.size() == 32);
+        CHECK(copy.representation() == std::string(32, 'a') + "b");
+    }
+}
+
 TEST_CASE("modules") {
     constexpr std::size_t memsize = 512;
     ps::context ctx(memsize);
@@ -503,6 +626,406 @@ TEST_CASE("modules") {
     }
 }
 
+TEST_CASE("snapshots") {
+    constexpr std::size_t memsize = 1024;
+    ps::context ctx(memsize);
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+
+    ps::script setup(R"(
+        let x = 1;
+        let values = [1, 2, 3];
+        fn get() -> int {
+            return 7;
+        }
+    )", ctx);
+    ctx.execute(setup, exec);
+
+    auto const saved = ctx.snapshot();
+
+    ps::script modify(R"(
+        x = 5;
+        values.append(4);
+        values[0] = 10;
+        fn other() -> int {
+            return 8;
+        }
+    )", ctx);
+
+    // restoring twice checks that the checkpoint is not modified by later changes
+    for (int i = 0; i < 2; ++i) {
+        ctx.execute(modify, exec);
+        CHECK(static_cast<int const&>(ctx.get_variable_value("x")) == 5);
+
+        ctx.restore(saved);
+        CHECK(static_cast<int const&>(ctx.get_variable_value("x")) == 1);
+
+        ps::script check(R"(
+            __print(values);
+            __print(get());
+        )", ctx);
+        out.str("");
+        ctx.execute(check, exec);
+        CHECK(output_equal(exec, "[1, 2, 3]\n7\n"));
+    }
+
+    // globals that share a list still share it after a restore
+    ps::script alias(R"(
+        let shared = values;
+        let alias = &values;
+    )", ctx);
+    ctx.execute(alias, exec);
+    auto const aliased = ctx.snapshot();
+    ctx.restore(aliased);
+    ps::script append(R"(
+        shared.append(4);
+        alias.append(5);
+        __print(values);
+    )", ctx);
+    out.str("");
+    ctx.execute(append, exec);
+    CHECK(output_equal(exec, "[1, 2, 3, 4, 5]\n"));
+
+    // so do lists shared by elements of other lists
+    ps::script nested(R"(
+        let inner = [1];
+        let outer = [inner, inner];
+    )", ctx);
+    ctx.execute(nested, exec);
+    auto const nested_saved = ctx.snapshot();
+    ctx.restore(nested_saved);
+    ps::script append_inner(R"(
+        inner.append(2);
+        __print(outer);
+    )", ctx);
+    out.str("");
+    ctx.execute(append_inner, exec);
+    CHECK(output_equal(exec, "[[1, 2], [1, 2]]\n"));
+}
+
+TEST_CASE("context reuse") {
+    constexpr std::size_t memsize = 1024;
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+
+    std::string source = R"(
+        import std.io;
+        let x = 5;
+        fn get() -> int {
+            return x;
+        }
+        struct Point {
+            x: int = 0;
+        };
+        std.io.print(get());
+    )";
+
+    SECTION("reset") {
+        ps::context ctx(memsize);
+        for (int i = 0; i < 2; ++i) {
+            ps::script script(source, ctx);
+            ctx.execute(script, exec);
+            CHECK(ctx.find_function("get"));
+            CHECK(ctx.find_function("std.io.print"));
+
+            ctx.reset();
+            CHECK_THROWS(ctx.get_variable("x"));
+            CHECK(!ctx.find_function("get"));
+            CHECK(!ctx.find_function("std.io.print"));
+
+            std::ostringstream err {};
+            ps::execution_context checked = exec;
+            checked.err = &err;
+            ps::script construct(R"(
+                let p = Point{1};
+            )", ctx);
+            ctx.execute(construct, checked);
+            CHECK(err.str().find("Struct 'Point' not defined") != std::string::npos);
+            ctx.reset();
+        }
+        CHECK(output_equal(exec, "5\n5\n"));
+    }
+
+    SECTION("pool") {
+        ps::context_pool pool(memsize);
+        {
+            auto ctx = pool.acquire();
+            ps::script script(source, *ctx);
+            ctx->execute(script, exec);
+            CHECK(pool.available() == 0);
+        }
+        CHECK(pool.available() == 1);
+
+        auto ctx = pool.acquire();
+        CHECK(pool.available() == 0);
+        CHECK_THROWS(ctx->get_variable("x"));
+        ps::script script(source, *ctx);
+        ctx->execute(script, exec);
+        CHECK(output_equal(exec, "5\n5\n"));
+    }
+}
+
+TEST_CASE("precompiled scripts") {
+    constexpr std::size_t memsize = 1024;
+    ps::context ctx(memsize);
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+
+    SECTION("save and load") {
+        ps::script original(R"(
+            import std.io;
+            fn greet(name: str) -> str {
+                return "hello " + name;
+            }
+            let values = [1.5, 2.5];
+            std.io.print(greet("world"));
+            std.io.print(values[1]);
+        )", ctx);
+
+        std::stringstream binary {};
+        original.save(binary);
+        ps::script loaded(binary);
+        CHECK(loaded.source() == original.source());
+
+        ctx.execute(loaded, exec);
+        CHECK(output_equal(exec, "hello world\n2.5\n"));
+    }
+
+    SECTION("invalid data") {
+        std::stringstream binary { "not a precompiled script" };
+        CHECK_THROWS(ps::script(binary));
+    }
+}
+
+TEST_CASE("module cache") {
+    ps::context a(512);
+    ps::context b(512);
+
+    auto first = ps::module_cache::global().load("pscript-modules/std/io.ps", a);
+    auto second = ps::module_cache::global().load("pscript-modules/std/io.ps", b);
+    CHECK(first != nullptr);
+    CHECK(first == second);
+    CHECK(ps::module_cache::global().load("pscript-modules/std/does_not_exist.ps", a) == nullptr);
+
+    std::string const path = ps::module_cache::global().resolve("std.io", { "pscript-modules/" });
+    CHECK(!path.empty());
+    CHECK(path == ps::module_cache::global().resolve("std.io", { "does-not-exist/", "pscript-modules/" }));
+    CHECK(ps::module_cache::global().resolve("std.does_not_exist", { "pscript-modules/" }).empty());
+
+    SECTION("preload") {
+        ps::script script(R"(
+            import std.io;
+            import std.math;
+            fn f() -> void {
+                import std.string;
+            }
+        )", a);
+        CHECK(script.imports() == std::vector<std::string>{ "std.io", "std.math", "std.string" });
+
+        ps::module_cache::global().preload(script, { "pscript-modules/" }, a);
+        auto math = ps::module_cache::global().load(ps::module_cache::global().resolve("std.math", { "pscript-modules/" }), a);
+        CHECK(math != nullptr);
+    }
+}
+
+TEST_CASE("mapped files") {
+    constexpr std::size_t memsize = 1024;
+    ps::context ctx(memsize);
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+
+    // large enough to be memory mapped
+    std::string source = "import std.io;\n";
+    while (source.size() < ps::mapped_file::mapping_threshold) {
+        source += "// generated padding to make this file larger\n";
+    }
+    source += "std.io.print(5);\n";
+    {
+        std::ofstream file { "mapped_test.ps", std::ios::binary };
+        file << source;
+    }
+
+    ps::mapped_file file { "mapped_test.ps" };
+    CHECK(file.is_mapped());
+    CHECK(file.contents() == source);
+
+    ps::script script(std::move(file), ctx);
+    CHECK(script.source() == source);
+    ctx.execute(script, exec);
+    CHECK(output_equal(exec, "5\n"));
+
+    CHECK_THROWS(ps::mapped_file("does_not_exist.ps"));
+}
+
+static bool same_ast(ps::ast_node const& a, ps::ast_node const& b) {
+    if (a.tag != b.tag || a.original_tag != b.original_tag) return false;
+    if (a.line != b.line || a.column != b.column) return false;
+    if (a.is_token != b.is_token || a.token != b.token || a.sym != b.sym) return false;
+    if (a.child_count != b.child_count) return false;
+    for (std::size_t i = 0; i < a.child_count; ++i) {
+        if (!same_ast(a.nodes()[i], b.nodes()[i])) return false;
+    }
+    return true;
+}
+
+TEST_CASE("native parser") {
+    constexpr std::size_t memsize = 1024;
+    ps::context peg(memsize);
+    ps::context native(memsize, ps::parser_backend::native);
+    CHECK(native.backend() == ps::parser_backend::native);
+
+    SECTION("same ast as peglib") {
+        for (std::string const source : {
+            "let x = 5;",
+            "let y = 1 + 2 * (3 - 4) / 5 << 1;",
+            R"(
+                import std.io;
+                // comment
+                struct Point {
+                    x: float = 0.0;
+                    y: float = 0.0;
+                };
+                fn length(p: Point, values: list) -> float {
+                    let sum = 0.0;
+                    let x = p->x;
+                    for (let i = 0; i < values.size(); i += 1) {
+                        sum += values[i] * x;
+                    }
+                    for (let v : values) { if (v > 1.0) { sum = sum + v; } else { sum -= 1.0; } }
+                    for (let i : 0..3) { sum = -sum; }
+                    while (sum >= 10.0 && sum != 11.0) { sum /= 2.0; }
+                    return sum;
+                }
+                let p = Point{1.0, 2.0};
+                let l = [1.0, 2.5];
+                std.io.print(length(p, l), "length: ", true);
+            )"
+        }) {
+            ps::script a(source, peg);
+            ps::script b(source, native);
+            REQUIRE(a.ast() != nullptr);
+            REQUIRE(b.ast() != nullptr);
+            CHECK(same_ast(*a.ast(), *b.ast()));
+        }
+    }
+
+    SECTION("execute") {
+        std::ostringstream out {};
+        ps::execution_context exec {};
+        exec.out = &out;
+
+        ps::script script(R"(
+            import std.io;
+            fn fib(n: int) -> int {
+                if (n < 2) { return n; }
+                return fib(n - 1) + fib(n - 2);
+            }
+            std.io.print(fib(10));
+        )", native);
+        native.execute(script, exec);
+        CHECK(output_equal(exec, "55\n"));
+    }
+}
+
+TEST_CASE("packrat modes") {
+    constexpr std::size_t memsize = 1024;
+    std::string const source = "let x = ((((1 + 2) * 3) - f(4, g(5))) / 6);";
+    ps::context reference_ctx(memsize);
+    ps::script reference(source, reference_ctx);
+    REQUIRE(reference.ast() != nullptr);
+
+    for (ps::parser_backend backend : { ps::parser_backend::peglib, ps::parser_backend::native }) {
+        for (ps::packrat_mode mode : { ps::packrat_mode::off, ps::packrat_mode::on, ps::packrat_mode::adaptive }) {
+            ps::context ctx(memsize, backend, mode);
+            CHECK(ctx.packrat() == mode);
+            ps::script script(source, ctx);
+            REQUIRE(script.ast() != nullptr);
+            CHECK(same_ast(*reference.ast(), *script.ast()));
+
+            ps::parse_stats const& stats = script.stats();
+            CHECK(stats.packrat == (mode != ps::packrat_mode::off));
+            CHECK((stats.memo_entries != 0) == stats.packrat);
+            CHECK(stats.peak_bytes >= script.tree().memory_usage());
+        }
+    }
+
+    ps::context ctx(memsize, ps::parser_backend::peglib, ps::packrat_mode::adaptive);
+    CHECK(ctx.use_packrat(ps::adaptive_packrat_limit));
+    CHECK(!ctx.use_packrat(ps::adaptive_packrat_limit + 1));
+}
+
+TEST_CASE("interactive mode") {
+    constexpr std::size_t memsize = 1024;
+    ps::context ctx(memsize);
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+    ps::repl repl(ctx, exec);
+
+    CHECK(repl.feed("import std.io;"));
+    CHECK(!repl.feed("fn f(x: int) -> int {"));
+    CHECK(repl.pending());
+    CHECK(!repl.feed("    return x * 2; // comment with a }"));
+    CHECK(repl.feed("}"));
+    CHECK(!repl.pending());
+    CHECK(repl.feed("std.io.print(f(2));"));
+    // only the chunk defining f is still alive
+    CHECK(repl.parsed_chunks() == 1);
+
+    // redefining f releases the old definition
+    for (int i = 0; i < 10; ++i) {
+        CHECK(repl.feed("fn f(x: int) -> int { return x * 3; }"));
+        CHECK(repl.parsed_chunks() == 1);
+    }
+    CHECK(repl.feed("std.io.print(f(2));"));
+    CHECK(output_equal(exec, "4\n6\n"));
+
+    SECTION("else on the next line") {
+        out.str("");
+        CHECK(repl.feed("let x = 1;"));
+        CHECK(!repl.feed("if (x == 2) {"));
+        CHECK(!repl.feed("    __print(1);"));
+        // the if statement waits for the next line, which continues it
+        CHECK(!repl.feed("}"));
+        CHECK(repl.pending());
+        CHECK(!repl.feed("else {"));
+        CHECK(!repl.feed("    __print(2);"));
+        CHECK(repl.feed("}"));
+
+        // a line without else executes the waiting if statement first
+        CHECK(!repl.feed("if (x == 1) { __print(3); }"));
+        CHECK(repl.feed("__print(4);"));
+        CHECK(!repl.feed("if (x == 1) { __print(5); }"));
+        CHECK(repl.flush());
+        CHECK(!repl.pending());
+        CHECK(output_equal(exec, "2\n3\n4\n5\n"));
+    }
+
+    SECTION("errors in functions") {
+        std::ostringstream err {};
+        ps::execution_context failing = exec;
+        failing.err = &err;
+        ps::repl errors(ctx, failing);
+        CHECK(errors.feed("fn fail() -> int { return missing; }"));
+        CHECK(errors.feed("fail();"));
+        CHECK(!err.str().empty());
+        // the failed call is no longer on the call stack, so redefining a function releases its old chunk right away
+        for (int i = 0; i < 10; ++i) {
+            CHECK(errors.feed("fn fail() -> int { return 1; }"));
+            CHECK(errors.parsed_chunks() == 1);
+        }
+    }
+}
+
 TEST_CASE("stdlib") {
     constexpr std::size_t memsize = 512;
     ps::context ctx(memsize);
@@ -643,6 +1166,564 @@ TEST_CASE("external functions") {
     ctx.execute(script, exec);
 }
 
+int sum10(int a, int b, int c, int d, int e, int f, int g, int h, int i, int j) {
+    return a + b + c + d + e + f + g + h + i + j;
+}
+
+TEST_CASE("external function arguments") {
+    constexpr size_t memsize = 1024;
+    ps::context ctx(memsize);
+
+    ps::extern_library lib {};
+    lib.add_function("sum10", &sum10);
+    lib.add_function("greet", [](ps::string_type const& name, int times) {
+        std::string result;
+        for (int i = 0; i < times; ++i) result += "hello " + std::string(name.c_str()) + " ";
+        return ps::string_type { result };
+    });
+    lib.add_function("half", [](float x) { return x / 2.0; });
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+    exec.externs = &lib;
+
+    ps::script script(R"(
+        extern fn sum10(a: int, b: int, c: int, d: int, e: int, f: int, g: int, h: int, i: int, j: int) -> int;
+        extern fn greet(name: str, times: int) -> str;
+        extern fn half(x: float) -> float;
+
+        __print(sum10(1, 2, 3, 4, 5, 6, 7, 8, 9, sum10(1, 1, 1, 1, 1, 1, 1, 1, 1, 1)));
+        __print(greet("world", 2));
+        __print(half(5));
+    )", ctx);
+    ctx.execute(script, exec);
+    CHECK(output_equal(exec, "55\nhello world hello world \n2.5\n"));
+
+    ps::extern_function const* f = lib.get_function("sum10");
+    REQUIRE(f != nullptr);
+    CHECK(f->arity() == 10);
+    std::vector<ps::value> args {};
+    for (int i = 0; i < 10; ++i) args.push_back(ps::value::from(ctx.memory(), i));
+    CHECK(f->call(ctx.memory(), args).cast<int>() == 45);
+    CHECK_THROWS(f->call(ctx.memory(), std::span<ps::value const> { args }.first(9)));
+
+    ps::extern_function const* g = lib.get_function("greet");
+    REQUIRE(g != nullptr);
+    REQUIRE(g->parameter_types().size() == 2);
+    CHECK(g->parameter_types()[0] == ps::type::str);
+    CHECK(g->parameter_types()[1] == ps::type::integer);
+    CHECK(g->result_type() == ps::type::str);
+}
+
+TEST_CASE("external list views") {
+    constexpr size_t memsize = 1024;
+    ps::context ctx(memsize);
+
+    ps::extern_library lib {};
+    lib.add_function("sum", [](std::span<float const> values) {
+        float sum = 0.0f;
+        for (float v : values) sum += v;
+        return sum;
+    });
+    lib.add_function("double_all", [](std::span<int> values) {
+        for (int& v : values) v *= 2;
+    });
+    lib.add_function("count", [](std::span<ps::value const> values) {
+        return static_cast<int>(values.size());
+    });
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+    exec.externs = &lib;
+
+    ps::script script(R"(
+        extern fn sum(values: list) -> float;
+        extern fn double_all(values: list) -> void;
+        extern fn count(values: list) -> int;
+
+        let reals = [1.5, 2.5, 3.0];
+        let ints = [1, 2, 3];
+        __print(sum(reals));
+        __print(sum(ints));
+        double_all(ints);
+        __print(ints);
+        __print(count(ints));
+    )", ctx);
+    ctx.execute(script, exec);
+    CHECK(output_equal(exec, "7\n6\n[2, 4, 6]\n3\n"));
+}
+
+TEST_CASE("external batch functions") {
+    constexpr size_t memsize = 1024;
+    ps::context ctx(memsize);
+
+    int calls = 0;
+    ps::extern_library lib {};
+    lib.add_batch_function("scale", [&calls](std::span<float const> x, float factor, std::span<float> result) {
+        ++calls;
+        for (std::size_t i = 0; i < x.size(); ++i) result[i] = x[i] * factor;
+    });
+    lib.add_batch_function("add", [](std::span<float const> a, std::span<float const> b, std::span<float> result) {
+        for (std::size_t i = 0; i < a.size(); ++i) result[i] = a[i] + b[i];
+    });
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+    exec.externs = &lib;
+
+    ps::script script(R"(
+        extern fn scale(x: float, factor: float) -> float;
+        extern fn add(a: float, b: float) -> float;
+
+        let xs = [1.0, 2.0, 3.0];
+        __print(scale(xs, 2.0));
+        __print(scale(1.5, 2.0));
+        __print(add(xs, 1.0));
+        __print(add(xs, [0.5, 0.5, 0.5]));
+    )", ctx);
+    ctx.execute(script, exec);
+    CHECK(calls == 2);
+    CHECK(output_equal(exec, "[2, 4, 6]\n3\n[2, 3, 4]\n[1.5, 2.5, 3.5]\n"));
+}
+
+// counts how often functions are looked up
+class counting_library : public ps::extern_library {
+public:
+    ps::extern_function const* get_function(std::string const& name) override {
+        ++lookups;
+        return ps::extern_library::get_function(name);
+    }
+
+    int lookups = 0;
+};
+
+TEST_CASE("external native structs") {
+    constexpr size_t memsize = 1024 * 1024;
+    ps::context ctx(memsize);
+
+    ps::extern_library lib {};
+    lib.add_function("centroid_x", [](std::span<Point const> points) {
+        float sum = 0.0f;
+        for (Point const& p : points) sum += p.x;
+        return sum / static_cast<float>(points.size());
+    });
+    lib.add_function("translate", [](std::span<Point> points, float dx, float dy) {
+        for (Point& p : points) {
+            p.x += dx;
+            p.y += dy;
+        }
+    });
+    lib.add_function("length_squared", [](Point p) { return p.x * p.x + p.y * p.y; });
+
+    std::ostringstream out {};
+    std::ostringstream err {};
+    ps::execution_context exec {};
+    exec.out = &out;
+    exec.err = &err;
+    exec.externs = &lib;
+
+    SECTION("matching layout") {
+        ps::script script(R"(
+            struct Point {
+                x: float = 0.0;
+                y: float = 0.0;
+            };
+
+            extern fn centroid_x(points: list) -> float;
+            extern fn translate(points: list, dx: float, dy: float) -> void;
+            extern fn length_squared(p: Point) -> float;
+
+            let points = [Point{1.0, 2.0}, Point{3.0, 4.0}];
+            __print(centroid_x(points));
+            translate(points, 1.0, -1.0);
+            let moved = points[1];
+            __print(moved->x);
+            __print(moved->y);
+            __print(length_squared(Point{3.0, 4.0}));
+        )", ctx);
+        ctx.execute(script, exec);
+        CHECK(output_equal(exec, "2\n4\n3\n25\n"));
+    }
+
+    SECTION("mismatched layout") {
+        ps::script script(R"(
+            struct Point {
+                x: int = 0;
+                y: float = 0.0;
+            };
+
+            extern fn centroid_x(points: list) -> float;
+            __print(centroid_x([Point{1, 2.0}]));
+        )", ctx);
+        ctx.execute(script, exec);
+        CHECK(output_equal(exec, ""));
+        CHECK(err.str().find("does not match the layout") != std::string::npos);
+    }
+}
+
+TEST_CASE("external function binding") {
+    constexpr size_t memsize = 1024;
+    ps::context ctx(memsize);
+
+    counting_library lib {};
+    lib.add_function(ctx, "add", &add);
+    counting_library other_lib {};
+    other_lib.add_function(ctx, "add", &add);
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+    exec.externs = &lib;
+
+    ps::script declaration(R"(
+        extern fn add(a: float, b: float) -> float;
+    )", ctx);
+    ctx.execute(declaration, exec);
+
+    ps::script calls(R"(
+        let sum = 0.0;
+        for (let i = 0; i < 10; i += 1) {
+            sum = add(sum, 1.0);
+        }
+        __print(sum);
+    )", ctx);
+    ctx.execute(calls, exec);
+    ctx.execute(calls, exec);
+    CHECK(lib.lookups == 1);
+    CHECK(output_equal(exec, "10\n10\n"));
+
+    // a different library binds the function again
+    exec.externs = &other_lib;
+    ctx.execute(calls, exec);
+    CHECK(lib.lookups == 1);
+    CHECK(other_lib.lookups == 1);
+
+    // so does adding a function to the library, or linking another library after it
+    other_lib.add_function(ctx, "sub", &add);
+    ctx.execute(calls, exec);
+    CHECK(other_lib.lookups == 2);
+    ctx.execute(calls, exec);
+    CHECK(other_lib.lookups == 2);
+    other_lib.next = std::make_unique<ps::extern_library>();
+    ctx.execute(calls, exec);
+    CHECK(other_lib.lookups == 3);
+
+    // a new library at the address of a destroyed one is a different library
+    auto replaced = std::make_unique<counting_library>();
+    replaced->add_function(ctx, "add", &add);
+    exec.externs = replaced.get();
+    ctx.execute(calls, exec);
+    CHECK(replaced->lookups == 1);
+    void* const address = replaced.get();
+    replaced.reset();
+    replaced = std::make_unique<counting_library>();
+    replaced->add_function(ctx, "add", &add);
+    if (replaced.get() == address) {
+        ctx.execute(calls, exec);
+        CHECK(replaced->lookups == 1);
+    }
+}
+
+TEST_CASE("external reference parameters") {
+    constexpr size_t memsize = 1024;
+    ps::context ctx(memsize);
+
+    ps::extern_library lib {};
+    lib.add_function("input_float", [](ps::string_type const& label, float& value) {
+        value += static_cast<float>(label.size());
+        return true;
+    });
+    lib.add_function("increment", [](int& value) {
+        ++value;
+    });
+
+    std::ostringstream out {};
+    std::ostringstream err {};
+    ps::execution_context exec {};
+    exec.out = &out;
+    exec.err = &err;
+    exec.externs = &lib;
+
+    ps::script script(R"(
+        extern fn input_float(label: str, value: float) -> bool;
+        extern fn increment(value: int) -> void;
+        let x = 1.0;
+        input_float("abc", &x);
+        let i = 5;
+        increment(&i);
+        increment(&i);
+        __print(x);
+        __print(i);
+    )", ctx);
+    ctx.execute(script, exec);
+    CHECK(output_equal(exec, "4\n7\n"));
+    CHECK(err.str().empty());
+
+    // without & there is no variable to write to
+    ps::script copy(R"(
+        increment(i);
+    )", ctx);
+    ctx.execute(copy, exec);
+    CHECK(err.str().find("Expected a reference to a variable of type int") != std::string::npos);
+
+    SECTION("nested external calls") {
+        out.str("");
+        err.str("");
+        // the handle runs a script function that makes more external calls while value still refers to the argument
+        lib.add_function("apply", [&ctx](ps::value const& value) -> int {
+            int const nested = ctx.find_function("nested").call<int>();
+            return static_cast<int const&>(value) + nested;
+        });
+        lib.add_function("sum", [](int a, int b, int c, int d, int e, int f, int g, int h) {
+            return a + b + c + d + e + f + g + h;
+        });
+
+        ps::script nested(R"(
+            extern fn apply(value: int) -> int;
+            extern fn sum(a: int, b: int, c: int, d: int, e: int, f: int, g: int, h: int) -> int;
+            fn nested() -> int {
+                return sum(1, 2, 3, 4, 5, 6, 7, sum(1, 1, 1, 1, 1, 1, 1, 1));
+            }
+            __print(apply(100));
+            __print(sum(1, 1, 1, 1, 1, 1, 1, apply(10)));
+        )", ctx);
+        ctx.execute(nested, exec);
+        CHECK(err.str().empty());
+        CHECK(output_equal(exec, "136\n53\n"));
+    }
+}
+
+TEST_CASE("asynchronous external functions") {
+    constexpr size_t memsize = 1024 * 1024;
+    ps::context ctx(memsize);
+
+    std::promise<int> promise {};
+    std::future<int> pending = promise.get_future();
+
+    ps::extern_library lib {};
+    lib.add_function("load", [&pending](int x) {
+        return x == 0 ? std::move(pending) : std::async(std::launch::async, [x] { return x * 2; });
+    });
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+    exec.externs = &lib;
+
+    SECTION("blocking") {
+        ps::script script(R"(
+            extern fn load(x: int) -> int;
+            __print(load(21));
+        )", ctx);
+        ctx.execute(script, exec);
+        CHECK(output_equal(exec, "42\n"));
+    }
+
+    SECTION("suspended") {
+        ps::script script(R"(
+            extern fn load(x: int) -> int;
+            __print(1);
+            let loaded = load(0);
+            __print(loaded);
+            __print(load(5));
+        )", ctx);
+
+        ps::execution run { ctx, script, exec };
+        CHECK(!run.resume());
+        CHECK(output_equal(exec, "1\n"));
+        // the result is not ready, so the script does not continue
+        CHECK(!run.resume());
+        CHECK(!run.finished());
+
+        promise.set_value(7);
+        while (!run.resume()) {}
+        CHECK(run.finished());
+        CHECK(output_equal(exec, "1\n7\n10\n"));
+    }
+
+    SECTION("destroyed while suspended") {
+        ps::script script(R"(
+            extern fn load(x: int) -> int;
+            __print(load(0));
+        )", ctx);
+
+        {
+            ps::execution run { ctx, script, exec };
+            CHECK(!run.resume());
+        }
+        CHECK(output_equal(exec, ""));
+    }
+
+    SECTION("destroyed inside a function") {
+        ps::script script(R"(
+            extern fn load(x: int) -> int;
+            fn wait() -> int {
+                return load(0);
+            }
+            __print(wait());
+        )", ctx);
+
+        {
+            ps::execution run { ctx, script, exec };
+            CHECK(!run.resume());
+        }
+
+        // the call to wait() was unwound, so redefining a function releases the script that defined it right away
+        auto first = std::make_shared<ps::script>("fn f() -> int { return 1; }", ctx);
+        std::weak_ptr<ps::script> released = first;
+        ctx.execute(first, exec);
+        first.reset();
+        ctx.execute(std::make_shared<ps::script>("fn f() -> int { return 2; }", ctx), exec);
+        CHECK(released.expired());
+    }
+
+    SECTION("externs run on the host thread") {
+        std::vector<std::thread::id> threads {};
+        lib.add_function("record_thread", [&threads]() {
+            threads.push_back(std::this_thread::get_id());
+        });
+
+        std::string const source = R"(
+            extern fn load(x: int) -> int;
+            extern fn record_thread() -> void;
+            record_thread();
+            __print(load(1) + load(1));
+            record_thread();
+        )";
+        ps::script script(source, ctx);
+        ps::context other(memsize);
+        ps::script other_script(source, other);
+
+        // two scripts suspended at the same time still run on this thread
+        {
+            ps::execution first { ctx, script, exec };
+            ps::execution second { other, other_script, exec };
+            bool first_done = false;
+            bool second_done = false;
+            while (!first_done || !second_done) {
+                first_done = first.resume();
+                second_done = second.resume();
+            }
+        }
+        for (int i = 0; i < 50; ++i) {
+            ps::execution run { ctx, script, exec };
+            while (!run.resume()) {}
+        }
+
+        CHECK(threads.size() == 52 * 2);
+        bool host_thread = true;
+        for (std::thread::id id : threads) host_thread = host_thread && id == std::this_thread::get_id();
+        CHECK(host_thread);
+        CHECK(out.str().size() == 52 * 2);
+    }
+}
+
+TEST_CASE("perfect hash") {
+    std::vector<std::string> keys {};
+    for (int i = 0; i < 1000; ++i) keys.push_back("module.function_" + std::to_string(i));
+
+    ps::perfect_hash table { keys };
+    CHECK(table.size() == keys.size());
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        CHECK(table.find(keys[i]) == i);
+    }
+    CHECK(table.find("module.function_1000") == ps::perfect_hash::npos);
+    CHECK(table.find("") == ps::perfect_hash::npos);
+    CHECK(ps::perfect_hash {}.find("x") == ps::perfect_hash::npos);
+    CHECK_THROWS(ps::perfect_hash { std::vector<std::string> { "a", "b", "a" } });
+}
+
+TEST_CASE("extern registry") {
+    constexpr size_t memsize = 1024;
+    ps::context ctx(memsize);
+
+    int first_value = 1;
+    int second_value = 2;
+
+    auto first = std::make_unique<ps::extern_library>();
+    first->add_function("f", []() { return 1; });
+    first->add_variable("v", &first_value);
+    auto second = std::make_unique<ps::extern_library>();
+    second->add_function("f", []() { return 2; });
+    second->add_function("g", []() { return 3; });
+    second->add_variable("v", &second_value);
+    second->add_variable("w", &second_value);
+
+    std::unique_ptr<ps::extern_library> registry = ps::extern_library_chain_builder{}
+        .add(std::move(first))
+        .add(std::move(second))
+        .build();
+    // the chain is flattened, so it is never searched by the context
+    CHECK(registry->next == nullptr);
+    CHECK(registry->get_function("h") == nullptr);
+    CHECK(registry->get_variable("v") == &first_value);
+    CHECK(registry->get_variable("w") == &second_value);
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+    exec.externs = registry.get();
+
+    ps::script script(R"(
+        extern fn f() -> int;
+        extern fn g() -> int;
+        extern let v -> int;
+        __print(f());
+        __print(g());
+        __print(v);
+    )", ctx);
+    ctx.execute(script, exec);
+    CHECK(output_equal(exec, "1\n3\n1\n"));
+
+    SECTION("libraries that do not enumerate") {
+        // like the library of the perceptron demo, this only overrides the lookups
+        class lookup_library : public ps::extern_library {
+        public:
+            ps::extern_function const* get_function(std::string const& name) override {
+                return name == "h" ? &h : nullptr;
+            }
+
+            void* get_variable(std::string const& name) override {
+                return name == "u" ? &u : nullptr;
+            }
+
+            ps::extern_function h { []() { return 4; } };
+            int u = 5;
+        };
+
+        auto lookup = std::make_unique<lookup_library>();
+        int* u = &lookup->u;
+        auto late = std::make_unique<ps::extern_library>();
+        ps::extern_library* added_later = late.get();
+        std::unique_ptr<ps::extern_library> chain = ps::extern_library_chain_builder{}
+            .add(std::move(lookup))
+            .add(std::move(late))
+            .build();
+        added_later->add_function("k", []() { return 6; });
+
+        CHECK(chain->get_function("h") != nullptr);
+        CHECK(chain->get_variable("u") == u);
+        CHECK(chain->get_function("k") != nullptr);
+        CHECK(chain->get_function("missing") == nullptr);
+
+        out.str("");
+        exec.externs = chain.get();
+        ps::script lookups(R"(
+            extern fn h() -> int;
+            extern fn k() -> int;
+            extern let u -> int;
+            __print(h());
+            __print(k());
+            __print(u);
+        )", ctx);
+        ctx.execute(lookups, exec);
+        CHECK(output_equal(exec, "4\n6\n5\n"));
+    }
+}
+
 TEST_CASE("external types") {
     constexpr size_t memsize = 1024 * 1024;
     ps::context ctx(memsize);
@@ -671,6 +1752,56 @@ TEST_CASE("external types") {
         ctx.execute(script, exec);
     }
 
+    SECTION("scalars in host memory") {
+        std::ostringstream out {};
+        exec.out = &out;
+
+        ps::script script(R"(
+            extern let my_integer -> int;
+            my_integer += 5;
+            __print(my_integer * 2);
+        )", ctx);
+        ctx.execute(script, exec);
+        CHECK(my_integer == 15);
+
+        my_integer = 100;
+        ps::script read(R"(
+            __print(my_integer);
+            let copy = my_integer;
+            copy = 1;
+            my_integer = 2.5;
+        )", ctx);
+        ctx.execute(read, exec);
+        CHECK(output_equal(exec, "30\n100\n"));
+        CHECK(my_integer == 2);
+    }
+
+    SECTION("booleans in host memory") {
+        std::ostringstream out {};
+        std::ostringstream err {};
+        exec.out = &out;
+        exec.err = &err;
+        bool flag = false;
+        lib.add_variable("flag", &flag);
+
+        ps::script script(R"(
+            extern let flag -> bool;
+            flag = !flag;
+            __print(flag);
+        )", ctx);
+        ctx.execute(script, exec);
+        CHECK(flag);
+        CHECK(output_equal(exec, "1\n"));
+
+        // a failed assignment to host memory is reported like any other type error
+        ps::script invalid(R"(
+            flag = "yes";
+        )", ctx);
+        ctx.execute(invalid, exec);
+        CHECK(flag);
+        CHECK(err.str().find("TypeError") != std::string::npos);
+    }
+
     // note that modifying external types is not properly supported yet (TODO?)
     SECTION("structs") {
         std::string source = R"(
@@ -686,6 +1817,85 @@ TEST_CASE("external types") {
     }
 }
 
+TEST_CASE("function handles") {
+    constexpr size_t memsize = 1024 * 1024;
+    ps::context ctx(memsize);
+
+    std::ostringstream out {};
+    ps::execution_context exec {};
+    exec.out = &out;
+
+    ps::extern_library lib {};
+    lib.add_function("half", [](float x) { return x / 2.0f; });
+    exec.externs = &lib;
+
+    ps::script script(R"(
+        extern fn half(x: float) -> float;
+
+        let frames = 0;
+        fn add(a: int, b: int) -> int {
+            return a + b;
+        }
+        fn update(dt: float) -> void {
+            frames += 1;
+            __print(dt);
+        }
+    )", ctx);
+    ctx.execute(script, exec);
+
+    ps::function_handle sum = ctx.find_function("add");
+    REQUIRE(sum);
+    CHECK(sum.call<int>(2, 3) == 5);
+    // arguments are cast to the parameter types
+    CHECK(sum.call<float>(2.5f, 1u) == 3.0f);
+
+    ps::function_handle update = ctx.find_function("update");
+    REQUIRE(update.valid());
+    for (int i = 0; i < 3; ++i) update.call<void>(0.5f);
+    CHECK(static_cast<int const&>(ctx.get_variable_value("frames")) == 3);
+    CHECK(output_equal(exec, "0.5\n0.5\n0.5\n"));
+
+    CHECK(ctx.find_function("half").call<float>(3) == 1.5f);
+
+    CHECK(!ctx.find_function("missing"));
+    CHECK_THROWS(ps::function_handle {}.call());
+    CHECK_THROWS(sum.call<int>(1));
+
+    // handles look up their function again when all functions are replaced
+    auto saved = ctx.snapshot();
+    ctx.restore(saved);
+    CHECK(sum.call<int>(4, 5) == 9);
+    ctx.reset();
+    CHECK_THROWS(sum.call<int>(4, 5));
+
+    SECTION("redefined during a failing call") {
+        ps::extern_library redefining {};
+        ps::execution_context failing = exec;
+        failing.externs = &redefining;
+        redefining.add_function("redefine", [&ctx, &failing]() -> int {
+            ctx.execute(std::make_shared<ps::script>("fn g() -> int { return 2; }", ctx), failing);
+            throw std::runtime_error("failed after redefining g");
+        });
+
+        // the declaration would keep its script alive too, so it is made by another script
+        ctx.execute(std::make_shared<ps::script>("extern fn redefine() -> int;", ctx), failing);
+        auto first = std::make_shared<ps::script>(R"(
+            fn g() -> int {
+                return redefine();
+            }
+        )", ctx);
+        std::weak_ptr<ps::script> released = first;
+        ctx.execute(first, failing);
+        first.reset();
+        CHECK(!released.expired());
+
+        // the script that defined the old g is released once the call has unwound
+        CHECK_THROWS(ctx.find_function("g").call<int>());
+        CHECK(released.expired());
+        CHECK(ctx.find_function("g").call<int>() == 2);
+    }
+}
+
 TEST_CASE("perceptron") {
     constexpr size_t memsize = 1024 * 1024;
     ps::context ctx(memsize);
@@ -779,6 +1989,40 @@ TEST_CASE("error reporting") {
         ctx.execute(script, exec);
     }
 
+    SECTION("extern function signature mismatch") {
+        auto externs = ps::extern_library {};
+        externs.add_function(ctx, "foo", &test_f);
+        exec.externs = &externs;
+
+        std::string source = R"(
+            extern fn foo(x: str) -> void;
+
+            foo("abc");
+        )";
+
+        ps::script script(source, ctx);
+        ctx.execute(script, exec);
+    }
+
+    SECTION("variadic extern function result mismatch") {
+        std::ostringstream err {};
+        exec.err = &err;
+        auto externs = ps::extern_library {};
+        externs.add_function("sum", [](int a, int b) { return a + b; });
+        exec.externs = &externs;
+
+        // the arguments of a variadic declaration are only known per call, but the result type is still checked
+        std::string source = R"(
+            extern fn sum(values...) -> str;
+
+            sum(1, 2);
+        )";
+
+        ps::script script(source, ctx);
+        ctx.execute(script, exec);
+        CHECK(err.str().find("is declared to return str") != std::string::npos);
+    }
+
     SECTION("extern function not found") {
         auto externs = ps::extern_library {};
         exec.externs = &externs;
@@ -22,40 +22,43 @@ std::string read_file(const char* filename) {
 class extern_library : public ps::extern_library {
 public:
     template<typename C>
-    void add_function(ps::context& ctx, std::string const& name, C&& callable) {
-        functions.insert({name, plib::make_concrete_function<ps::value>(callable, [&ctx](auto x){
-            return ps::value::from(ctx.memory(), x);
-        })});
+    void add_function([[maybe_unused]] ps::context& ctx, std::string const& name, C&& callable) {
+        functions.insert({name, ps::extern_function { std::forward<C>(callable) }});
     }
 
     void add_variable(std::string const& name, void* ptr) {
         variables.insert({name, ptr});
     }
 
-    plib::erased_function<ps::value>* get_function(std::string const& name) override {
-        return functions.at(name);
+    ps::extern_function const* get_function(std::string const& name) override {
+        return &functions.at(name);
     }
 
     void* get_variable(std::string const& name) override {
         return variables.at(name);
     }
 
-    ~extern_library() {
-        for (auto& [k, v] : functions) {
-            delete v;
-        }
-        functions.clear();
-    }
-
 private:
-    std::unordered_map<std::string, plib::erased_function<ps::value>*> functions {};
+    std::unordered_map<std::string, ps::extern_function> functions {};
     std::unordered_map<std::string, void*> variables;
 };
 
+// same layout as imgui.PlotPoint in ps/imgui.ps
+struct PlotPoint {
+    float x;
+    float y;
+};
+
+template<>
+struct ps::native_layout<PlotPoint> {
+    static constexpr std::string_view name = "imgui.PlotPoint";
+    static constexpr auto fields = std::tuple { ps::field("x", &PlotPoint::x), ps::field("y", &PlotPoint::y) };
+};
+
 namespace ps_bindings {
 
 bool imgui_begin(ps::string_type const& str) {
-    return ImGui::Begin(str.representation().c_str());
+    return ImGui::Begin(str.c_str());
 }
 
 int imgui_end() {
@@ -64,35 +67,25 @@ int imgui_end() {
 }
 
 bool imgui_button(ps::string_type const& str) {
-    return ImGui::Button(str.representation().c_str());
+    return ImGui::Button(str.c_str());
 }
 
 ImPlotPoint list_data_getter(void* data, int idx) {
-    ps::list_type const* list = (ps::list_type const*)data;
-    auto const& vec = list->representation();
-    ps::value const& val = vec[idx];
-
-    ps::struct_type const& struc = static_cast<ps::struct_type const&>(val);
-    ps::value const& x = struc.access("x");
-    ps::value const& y = struc.access("y");
-
-    ImPlotPoint point {};
-    point.x = x.real_value().value();
-    point.y = y.real_value().value();
-    return point;
+    PlotPoint const* points = (PlotPoint const*)data;
+    return ImPlotPoint { points[idx].x, points[idx].y };
 }
 
 bool imgui_begin_plot(ps::string_type const& str) {
-    return ImPlot::BeginPlot(str.representation().c_str());
+    return ImPlot::BeginPlot(str.c_str());
 }
 
-int imgui_plot_scatter(ps::string_type const& str, ps::list_type const& data) {
-    ImPlot::PlotScatterG(str.representation().c_str(), list_data_getter, (void*) &data, data.size());
+int imgui_plot_scatter(ps::string_type const& str, std::span<PlotPoint const> data) {
+    ImPlot::PlotScatterG(str.c_str(), list_data_getter, (void*) data.data(), data.size());
     return 0;
 }
 
-int imgui_plot_line(ps::string_type const& str, ps::list_type const& data) {
-    ImPlot::PlotLineG(str.representation().c_str(), list_data_getter, (void*) &data, data.size());
+int imgui_plot_line(ps::string_type const& str, std::span<PlotPoint const> data) {
+    ImPlot::PlotLineG(str.c_str(), list_data_getter, (void*) data.data(), data.size());
     return 0;
 }
 
@@ -114,7 +107,7 @@ int imgui_same_line() {
 
 // data_ref is of type imgui.Reference
 bool imgui_input_float(ps::string_type const& id, float& data_ref) {
-    return ImGui::InputFloat(id.representation().c_str(), &data_ref);
+    return ImGui::InputFloat(id.c_str(), &data_ref);
 }
 
 int imgui_end_plot() {
@@ -172,6 +165,8 @@ int main() {
     exec.externs = &lib;
 
     ctx.execute(perceptron, exec);
+    ctx.execute(build_ui, exec);
+    ps::function_handle ui_frame = ctx.find_function("ui_frame");
 
     float last_time = glfwGetTime();
 
@@ -182,7 +177,7 @@ int main() {
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        ctx.execute(build_ui, exec);
+        ui_frame.call<void>();
 
         ImGui::Render();
         int display_w, display_h;